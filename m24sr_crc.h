@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef M24SR_CRC_H
+#define M24SR_CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * CRC engine used to protect the I2C frames (ISO/IEC 13239, CRC_A).
+ *   0: bit-serial, no table
+ *   1: 256-entry table (512 bytes of flash)
+ *   4: slicing-by-4 (2 KB of flash)
+ *   8: slicing-by-8 (4 KB of flash)
+ */
+#ifndef MBED_CONF_M24SR_CRC_ENGINE
+#define MBED_CONF_M24SR_CRC_ENGINE 1
+#endif
+
+#define M24SR_CRC_ENGINE_BITWISE   0
+#define M24SR_CRC_ENGINE_TABLE     1
+#define M24SR_CRC_ENGINE_SLICING_4 4
+#define M24SR_CRC_ENGINE_SLICING_8 8
+
+/** CRC preset defined by ITU-V.41 */
+#define M24SR_CRC_INIT             0x6363
+
+namespace mbed {
+namespace nfc {
+namespace vendor {
+namespace ST {
+
+/**
+ * Continue a CRC computation over a block of data.
+ * @param crc CRC of the data processed so far, M24SR_CRC_INIT for a new frame.
+ * @param data Data to add to the CRC.
+ * @param length Number of bytes in data.
+ * @return The updated CRC.
+ */
+uint16_t m24sr_crc16_update(uint16_t crc, const uint8_t *data, size_t length);
+
+/**
+ * Compute the CRC of a complete block of data.
+ * @param data Data to compute the CRC of.
+ * @param length Number of bytes in data.
+ * @return The CRC to append (LSB first) to the frame.
+ */
+inline uint16_t m24sr_crc16(const uint8_t *data, size_t length) {
+    return m24sr_crc16_update(M24SR_CRC_INIT, data, length);
+}
+
+} //ST
+} //vendor
+} //nfc
+} //mbed
+
+#endif // M24SR_CRC_H
@@ -34,7 +34,9 @@
  ******************************************************************************
  */
 
+#include <new>
 #include <m24sr_driver.h>
+#include "m24sr_crc.h"
 #include "Callback.h"
 
 namespace mbed {
@@ -42,16 +44,16 @@ namespace nfc {
 namespace vendor {
 namespace ST {
 
-#define MAX_OPERATION_SIZE         246
-#define MAX_PAYLOAD                241
-
 /** value returned by the NFC chip when a command is successfully completed */
 static constexpr const uint16_t NFC_COMMAND_SUCCESS = 0x9000;
-/** I2C nfc address */
-#define M24SR_ADDR                 0xAC
 
-#define SYSTEM_FILE_ID_BYTES      {0xE1,0x01}
-#define CC_FILE_ID_BYTES          {0xE1,0x03}
+#define SYSTEM_FILE_ID            0xE101
+#define CC_FILE_ID                0xE103
+#define DEFAULT_NDEF_FILE_ID      0x0001
+
+#define SYSTEM_FILE_GPO_OFFSET    0x0004
+#define SYSTEM_FILE_UID_OFFSET    0x0008
+#define SYSTEM_FILE_PRODUCT_CODE_OFFSET 0x0011
 
 #define UB_STATUS_OFFSET           4
 #define LB_STATUS_OFFSET           3
@@ -87,8 +89,14 @@ static constexpr const uint16_t NFC_COMMAND_SUCCESS = 0x9000;
 #define WATING_TIME_EXT_RESPONSE_LENGTH  4
 #define PASSWORD_LENGTH                  16
 
+/* typical time taken by the chip to answer, from the datasheet */
+#define COMMAND_TIME_US                  300
+#define SESSION_TIME_US                  500
+#define EEPROM_WRITE_TIME_US             5000
+#define EEPROM_WRITE_TIME_PER_BYTE_US    20
+
 #define DESELECT_REQUEST_COMMAND     {0xC2,0xE0,0xB4}
-#define SELECT_APPLICATION_COMMAND   {0xD2,0x76,0x00,0x00,0x85,0x01,0x01}
+#define NDEF_APPLICATION_ID          0xD2,0x76,0x00,0x00,0x85,0x01,0x01
 
 /* command structure mask */
 #define CMD_MASK_SELECT_APPLICATION     0x01FF
@@ -136,64 +144,93 @@ const uint8_t M24srDriver::default_password[16] = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
 
-/**
- * @brief This function updates the CRC
- */
-static uint16_t update_crc(uint8_t ch, uint16_t *lpw_crc) {
-    ch = (ch ^ (uint8_t) ((*lpw_crc) & 0x00FF));
-    ch = (ch ^ (ch << 4));
-    *lpw_crc = (*lpw_crc >> 8) ^ ((uint16_t) ch << 8) ^ ((uint16_t) ch << 3) ^ ((uint16_t) ch >> 4);
-
-    return (*lpw_crc);
-}
-
 /**
  * @brief This function returns the CRC 16
  * @param data  pointer on the data used to compute the CRC16
  * @param length  number of bytes of the data
  * @retval CRC16 
  */
-static uint16_t compute_crc(uint8_t *data, uint8_t length) {
-    uint8_t block;
-    uint16_t crc16 = 0x6363; /* ITU-V.41 */
+static inline uint16_t compute_crc(const uint8_t *data, uint16_t length) {
+    return m24sr_crc16(data, length);
+}
 
-    do {
-        block = *data++;
-        update_crc(block, &crc16);
-    } while (--length);
+/**
+ * @brief This function returns the CRC 16 of the first bytes of a frame split in fragments
+ * @param fragments  parts of the frame, in order
+ * @param length  number of bytes of the frame to use
+ * @retval CRC16
+ */
+static uint16_t compute_crc(const M24srFragment_t *fragments, size_t length) {
+    uint16_t crc = M24SR_CRC_INIT;
 
-    return crc16;
+    for (; length != 0; fragments++) {
+        const size_t part = (fragments->length < length) ? fragments->length : length;
+        crc = m24sr_crc16_update(crc, fragments->data, part);
+        length -= part;
+    }
+
+    return crc;
+}
+
+/**
+ * @brief This function returns a byte of a frame split in fragments
+ * @param fragments  parts of the frame, in order
+ * @param index  position of the byte in the frame
+ * @retval byte
+ */
+static uint8_t frame_byte(const M24srFragment_t *fragments, size_t index) {
+    while (index >= fragments->length) {
+        index -= fragments->length;
+        fragments++;
+    }
+
+    return fragments->data[index];
 }
 
 /**  
  * @brief This function computes the CRC16 residue as defined by CRC ISO/IEC 13239
- * @param data input data
- * @param length Number of bits of DataIn
+ * @param fragments  parts of the frame, in order
+ * @param count  number of fragments
  * @retval Status (SW1&SW2) CRC16 residue is correct
  * @retval M24SR_ERROR_CRC CRC16 residue is false
  */
-static M24srError_t is_correct_crc_residue(uint8_t *data, uint8_t length) {
+static M24srError_t is_correct_crc_residue(const M24srFragment_t *fragments, size_t count) {
     uint16_t res_crc = 0x0000;
     uint16_t status;
+    size_t length = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        length += fragments[i].length;
+    }
 
     /* check the CRC16 Residue */
     if (length != 0) {
-        res_crc = compute_crc(data, length);
+        res_crc = compute_crc(fragments, length);
     }
 
     if (res_crc == 0x0000) {
         /* Good CRC, but error status from M24SR */
-        status = ((data[length - UB_STATUS_OFFSET] << 8) & 0xFF00)
-            | (data[length - LB_STATUS_OFFSET] & 0x00FF);
+        status = ((frame_byte(fragments, length - UB_STATUS_OFFSET) << 8) & 0xFF00)
+            | (frame_byte(fragments, length - LB_STATUS_OFFSET) & 0x00FF);
+
+        /* zeros read past a status only frame keep its CRC right, the status is at its start */
+        if (status != NFC_COMMAND_SUCCESS && length > STATUS_RESPONSE_LENGTH
+                && compute_crc(fragments, STATUS_RESPONSE_LENGTH) == 0x0000) {
+            status = ((frame_byte(fragments, 1) << 8) & 0xFF00) | (frame_byte(fragments, 2) & 0x00FF);
+        }
     } else {
-        res_crc = 0x0000;
-        res_crc = compute_crc(data, 5);
+        /* a full length frame was already checked, don't run the CRC twice */
+        if (length <= STATUS_RESPONSE_LENGTH) {
+            return M24SR_IO_ERROR_CRC;
+        }
+
+        res_crc = compute_crc(fragments, STATUS_RESPONSE_LENGTH);
         if (res_crc != 0x0000) {
             /* Bad CRC */
             return M24SR_IO_ERROR_CRC;
         } else {
             /* Good CRC, but error status from M24SR */
-            status = ((data[1] << 8) & 0xFF00) | (data[2] & 0x00FF);
+            status = ((frame_byte(fragments, 1) << 8) & 0xFF00) | (frame_byte(fragments, 2) & 0x00FF);
         }
     }
 
@@ -204,30 +241,42 @@ static M24srError_t is_correct_crc_residue(uint8_t *data, uint8_t length) {
     return (M24srError_t)status;
 }
 
+/**
+ * @brief This function computes the CRC16 residue as defined by CRC ISO/IEC 13239
+ * @param data input data
+ * @param length Number of bytes of data
+ * @retval Status (SW1&SW2) CRC16 residue is correct
+ * @retval M24SR_ERROR_CRC CRC16 residue is false
+ */
+static M24srError_t is_correct_crc_residue(uint8_t *data, uint8_t length) {
+    const M24srFragment_t frame = { data, length };
+    return is_correct_crc_residue(&frame, 1);
+}
+
 /**
  * @brief This functions creates an I block command according to the structures command_mask and Command.
+ * The mask is a template parameter so that the tests of the absent fields are removed at compile time.
  * @param command_mask  structure which contains the field of the different parameters
  * @param command  structure of the command
+ * @param block  block number to use in the PCB byte
  * @param length  number of bytes of the command
  * @param command_buffer  pointer to the command created
  */
-static void build_I_block_command(uint16_t command_mask, C_APDU *command, uint8_t did, uint16_t *length,
+template<uint16_t command_mask>
+static void build_I_block_command(C_APDU *command, uint8_t did, uint8_t block, uint16_t *length,
                                   uint8_t *command_buffer) {
     uint16_t crc16;
-    static uint8_t block_number = 0x01;
 
     (*length) = 0;
 
     /* add the PCD byte */
     if ((command_mask & PCB_NEEDED) != 0) {
-        /* toggle the block number */
-        block_number = !block_number;
         /* Add the I block byte */
-        command_buffer[(*length)++] = 0x02 | block_number;
+        command_buffer[(*length)++] = 0x02 | block;
     }
 
     /* add the DID byte */
-    if ((block_number & DID_NEEDED) != 0) {
+    if ((block & DID_NEEDED) != 0) {
         /* Add the I block byte */
         command_buffer[(*length)++] = did;
     }
@@ -274,13 +323,89 @@ static void build_I_block_command(uint16_t command_mask, C_APDU *command, uint8_
 
     /* add CRC field  */
     if ((command_mask & CRC_NEEDED) != 0) {
-        crc16 = compute_crc(command_buffer, (uint8_t) (*length));
+        crc16 = compute_crc(command_buffer, *length);
         /* append the CRC16 */
         command_buffer[(*length)++] = GETLSB(crc16);
         command_buffer[(*length)++] = GETMSB(crc16);
     }
 }
 
+/* compile time version of the CRC, one byte at a time, used to build the fixed frames */
+static constexpr uint16_t fixed_crc_mix(uint16_t crc, uint8_t ch) {
+    return (uint16_t) ((crc >> 8) ^ ((uint16_t) ch << 8) ^ ((uint16_t) ch << 3) ^ (ch >> 4));
+}
+
+static constexpr uint16_t fixed_crc_byte(uint16_t crc, uint8_t byte) {
+    return fixed_crc_mix(crc, (uint8_t) ((byte ^ (uint8_t) crc) ^ (uint8_t) ((byte ^ (uint8_t) crc) << 4)));
+}
+
+static constexpr uint16_t fixed_crc(uint16_t crc) {
+    return crc;
+}
+
+template<typename... Bytes>
+static constexpr uint16_t fixed_crc(uint16_t crc, uint8_t byte, Bytes... bytes) {
+    return fixed_crc(fixed_crc_byte(crc, byte), bytes...);
+}
+
+/**
+ * I-block command without variable field, built by the compiler.
+ * frames[block] is the complete frame, PCB and CRC included, for each block number.
+ */
+template<uint8_t... Bytes>
+struct FixedIBlock {
+    static const uint8_t frames[2][sizeof...(Bytes) + 3];
+};
+
+template<uint8_t... Bytes>
+const uint8_t FixedIBlock<Bytes...>::frames[2][sizeof...(Bytes) + 3] = {
+    {
+        0x02, Bytes...,
+        GETLSB(fixed_crc(M24SR_CRC_INIT, 0x02, Bytes...)), GETMSB(fixed_crc(M24SR_CRC_INIT, 0x02, Bytes...))
+    },
+    {
+        0x03, Bytes...,
+        GETLSB(fixed_crc(M24SR_CRC_INIT, 0x03, Bytes...)), GETMSB(fixed_crc(M24SR_CRC_INIT, 0x03, Bytes...))
+    }
+};
+
+/** select file commands, same fields as CMD_MASK_SELECT_APPLICATION and CMD_MASK_SELECT_CC_FILE */
+typedef FixedIBlock<C_APDU_CLA_DEFAULT, C_APDU_SELECT_FILE, 0x04, 0x00, 0x07, NDEF_APPLICATION_ID, 0x00> SelectApplicationFrame;
+typedef FixedIBlock<C_APDU_CLA_DEFAULT, C_APDU_SELECT_FILE, 0x00, 0x0C, 0x02,
+                    GETMSB(CC_FILE_ID), GETLSB(CC_FILE_ID)> SelectCCFileFrame;
+typedef FixedIBlock<C_APDU_CLA_DEFAULT, C_APDU_SELECT_FILE, 0x00, 0x0C, 0x02,
+                    GETMSB(SYSTEM_FILE_ID), GETLSB(SYSTEM_FILE_ID)> SelectSystemFileFrame;
+typedef FixedIBlock<C_APDU_CLA_DEFAULT, C_APDU_SELECT_FILE, 0x00, 0x0C, 0x02,
+                    GETMSB(DEFAULT_NDEF_FILE_ID), GETLSB(DEFAULT_NDEF_FILE_ID)> SelectDefaultNdefFileFrame;
+
+/** DESELECT S-block, the CRC is included */
+static const uint8_t deselect_frame[] = DESELECT_REQUEST_COMMAND;
+
+/**
+ * @brief This function returns the typical time the chip needs before answering a command,
+ * it is the first wait of the POLL_BACKOFF strategy
+ * @param command  command sent to the chip
+ * @param length  number of bytes written by the command
+ * @retval time in microseconds
+ */
+static uint32_t expected_command_time(Command_t command, uint16_t length) {
+    switch (command) {
+    case GET_SESSION:
+        return SESSION_TIME_US;
+    case UPDATE:
+        return EEPROM_WRITE_TIME_US + (uint32_t) length * EEPROM_WRITE_TIME_PER_BYTE_US;
+    case CHANGE_REFERENCE_DATA:
+        return EEPROM_WRITE_TIME_US + PASSWORD_LENGTH * EEPROM_WRITE_TIME_PER_BYTE_US;
+    case ENABLE_VERIFICATION_REQUIREMENT:
+    case DISABLE_VERIFICATION_REQUIREMENT:
+    case ENABLE_PERMANET_STATE:
+    case DISABLE_PERMANET_STATE:
+        return EEPROM_WRITE_TIME_US;
+    default:
+        return COMMAND_TIME_US;
+    }
+}
+
 /**  
  * @brief This function returns M24SR_STATUS_SUCCESS if the buffer is an s-block
  * @param buffer        pointer to the data
@@ -296,47 +421,588 @@ static M24srError_t is_S_block(uint8_t *buffer) {
 }
 
 M24srDriver::M24srDriver(PinName i2c_data_pin, PinName i2c_clock_pin,
-                         PinName gpo_pin, PinName rf_disable_pin)
-    : _i2c_channel(i2c_data_pin, i2c_clock_pin),
-      _gpo_event_interrupt(gpo_pin),
+                         PinName gpo_pin, PinName rf_disable_pin, uint8_t address)
+    : M24srDriver(NULL, i2c_data_pin, i2c_clock_pin, gpo_pin, rf_disable_pin, address) {
+    /* driver requires valid pin names */
+    MBED_ASSERT(i2c_data_pin != NC);
+    MBED_ASSERT(i2c_clock_pin != NC);
+    MBED_ASSERT(gpo_pin != NC);
+    MBED_ASSERT(rf_disable_pin != NC);
+}
+
+M24srDriver::M24srDriver(M24srTransport &transport, PinName gpo_pin, PinName rf_disable_pin, uint8_t address)
+    : M24srDriver(&transport, NC, NC, gpo_pin, rf_disable_pin, address) {
+}
+
+M24srDriver::M24srDriver(M24srTransport *transport, PinName i2c_data_pin, PinName i2c_clock_pin,
+                         PinName gpo_pin, PinName rf_disable_pin, uint8_t address)
+    : _transport(transport),
+      _gpo_event_interrupt(NULL),
       _gpo_pin(gpo_pin),
       _rf_disable_pin(rf_disable_pin),
-      _command_cb(&_default_cb),
-      _subcommand_cb(NULL),
+      _operation(OPERATION_NONE),
+      _step(0),
+      _step_retries(0),
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+      _operation_request(false),
+      _request_head(0),
+      _request_count(0),
+      _request_running(false),
+      _request_cancelled(false),
+      _requests_dispatching(false),
+      _last_request_id(NO_REQUEST),
+      _request_delegate(this),
+#endif
       _communication_type(SYNC),
+      _requested_communication_type((Communication_t) MBED_CONF_M24SR_COMMUNICATION_MODE),
+      _pooled(false),
+      _answer_check_event(0),
+      _answer_start_us(0),
+      _sync_running(false),
+      _sync_pending(false),
+      _reset_pending(false),
+      _i2c_gpo_config(HIGH_IMPEDANCE),
+      _rf_gpo_config(HIGH_IMPEDANCE),
+      _rf_activity(false),
+      _gpo_event_pending(false),
+      _gpo_edge_missed(false),
+      _gpo_event(mbed::Callback<void()>(this, &M24srDriver::process_gpo_edge)),
       _last_command(NONE),
       _ndef_size(MAX_NDEF_SIZE),
+      _ndef_capacity(MAX_NDEF_SIZE - NDEF_FILE_HEADER_SIZE),
       _max_read_bytes(MAX_PAYLOAD),
       _max_write_bytes(MAX_PAYLOAD),
+      _address(address),
+      _block_number(0x01),
+      _cc_valid(false),
+      _system_file_valid(false),
+      _application_selected(false),
+      _selected_file(NO_FILE_SELECTED),
       _is_session_open(false) {
-    /* driver requires valid pin names */
-    MBED_ASSERT(i2c_data_pin != NC);
-    MBED_ASSERT(i2c_clock_pin != NC);
-    MBED_ASSERT(gpo_pin != NC);
-    MBED_ASSERT(rf_disable_pin != NC);
+    if (!_transport) {
+        _transport = new (_i2c_transport_storage) M24srI2CTransport(i2c_data_pin, i2c_clock_pin);
+    }
 
-    memset(_buffer, 0, 0xFF);
+    memset(_buffer, 0, sizeof(_buffer));
     _did_byte = 0;
+    _prepared_update.header_length = 0;
+
+    memset(&_cc, 0, sizeof(_cc));
+    _cc.ndef_file_id = DEFAULT_NDEF_FILE_ID;
+    memset(&_system_file, 0, sizeof(_system_file));
+
+    _poll_config.strategy = (PollStrategy_t) MBED_CONF_M24SR_POLL_STRATEGY;
+    _poll_config.timeout_us = MBED_CONF_M24SR_POLL_TIMEOUT_US;
+    _poll_config.interval_us = POLL_INTERVAL_US;
+    _poll_config.max_interval_us = POLL_MAX_INTERVAL_US;
+    reset_poll_statistics();
+    reset_gpo_event_statistics();
+#if MBED_CONF_M24SR_COMMAND_STATISTICS
+    reset_command_statistics();
+#endif
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+    memset(_shadow, 0, sizeof(_shadow));
+    memset(_shadow_valid, 0, sizeof(_shadow_valid));
+    memset(_shadow_dirty, 0, sizeof(_shadow_dirty));
+    _shadow_dirty_bytes = 0;
+    _ndef_size_valid = false;
+#endif
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
+    memset(_block_hash, 0, sizeof(_block_hash));
+    invalidate_block_hashes();
+#endif
 
     if (_rf_disable_pin.is_connected() != 0) {
         _rf_disable_pin = 0;
     }
 
     if (_gpo_pin.is_connected() != 0) {
-        _gpo_event_interrupt.fall(mbed::callback(this, &M24srDriver::nfc_interrupt_callback));
-        _gpo_event_interrupt.mode(PullUp);
-        _gpo_event_interrupt.disable_irq();
+        _gpo_event_interrupt = new (_gpo_event_interrupt_storage) InterruptIn(gpo_pin);
+        _gpo_event_interrupt->fall(mbed::callback(this, &M24srDriver::nfc_interrupt_callback));
+        _gpo_event_interrupt->mode(PullUp);
+        _gpo_event_interrupt->disable_irq();
+    }
+}
+
+M24srDriver::~M24srDriver() {
+    if (_gpo_event_interrupt) {
+        _gpo_event_interrupt->disable_irq();
+    }
+    _gpo_event.cancel();
+    if (_gpo_event_interrupt) {
+        _gpo_event_interrupt->~InterruptIn();
+    }
+
+    if (_transport == (M24srTransport*) _i2c_transport_storage) {
+        ((M24srI2CTransport*) _i2c_transport_storage)->~M24srI2CTransport();
+    }
+}
+
+/**
+ * @brief This function builds an I block command in the command buffer, toggling the block number
+ * @param command_mask  structure which contains the field of the different parameters
+ * @param command  structure of the command
+ * @param length  number of bytes of the command
+ */
+template<uint16_t command_mask>
+void M24srDriver::build_command(C_APDU *command, uint16_t *length) {
+    build_I_block_command<command_mask>(command, _did_byte, next_block_number(), length, _buffer);
+}
+
+/**
+ * @brief This function toggles the block number for a new I block
+ * @retval the block number to use in the PCB byte
+ */
+uint8_t M24srDriver::next_block_number() {
+    /* the block number of a prepared update is about to be used */
+    _prepared_update.header_length = 0;
+
+    _block_number = !_block_number;
+    return _block_number;
+}
+
+/** payload sent when an update binary is given no data */
+static const uint8_t erased_payload[MAX_OPERATION_SIZE] = { 0 };
+
+/**
+ * @brief This function builds the header and the CRC of the next update binary command,
+ * possibly while the chip is still busy with the previous one. The payload is sent from
+ * the caller memory, update_binary uses the prepared frame if called with the same parameters
+ * @param offset   first byte to write
+ * @param length   number of bytes to write
+ * @param data     data to write, NULL to write zeros
+ */
+void M24srDriver::prepare_update_binary(uint16_t offset, uint8_t length, const uint8_t *data) {
+    uint16_t header_length;
+    uint16_t crc16;
+
+    if (length > MAX_OPERATION_SIZE) {
+        length = MAX_OPERATION_SIZE;
+    }
+
+    C_APDU command(C_APDU_CLA_DEFAULT, C_APDU_UPDATE_BINARY, offset, length, data, 0);
+
+    /* the frame will be the next one sent, the payload and the CRC are left out */
+    build_I_block_command<CMD_MASK_UPDATE_BINARY & ~(DATA_NEEDED | CRC_NEEDED)>(&command, _did_byte, !_block_number,
+                                                                           &header_length, _prepared_update.header);
+
+    crc16 = m24sr_crc16_update(M24SR_CRC_INIT, _prepared_update.header, header_length);
+    crc16 = m24sr_crc16_update(crc16, data ? data : erased_payload, length);
+
+    _prepared_update.crc[0] = GETLSB(crc16);
+    _prepared_update.crc[1] = GETMSB(crc16);
+    _prepared_update.data = data;
+    _prepared_update.offset = offset;
+    _prepared_update.length = length;
+    _prepared_update.header_length = (uint8_t) header_length;
+}
+
+/**
+ * @brief This function decodes the CC file into the capability container cache
+ * @param cc_file  content of the CC file
+ */
+void M24srDriver::parse_capability_container(const uint8_t *cc_file) {
+    _cc.length = (uint16_t) ((cc_file[0x00] << 8) | cc_file[0x01]);
+    _cc.mapping_version = cc_file[0x02];
+    _cc.max_read_bytes = (uint16_t) ((cc_file[0x03] << 8) | cc_file[0x04]);
+    _cc.max_write_bytes = (uint16_t) ((cc_file[0x05] << 8) | cc_file[0x06]);
+    _cc.ndef_file_id = (uint16_t) ((cc_file[0x09] << 8) | cc_file[0x0A]);
+    _cc.ndef_file_max_size = (uint16_t) ((cc_file[0x0B] << 8) | cc_file[0x0C]);
+    _cc.read_access = cc_file[0x0D];
+    _cc.write_access = cc_file[0x0E];
+    _cc_valid = true;
+
+    /* a single response has to fit in the driver buffer */
+    _max_read_bytes = MAX_OPERATION_SIZE;
+    if (_cc.max_read_bytes != 0 && _cc.max_read_bytes < MAX_OPERATION_SIZE) {
+        _max_read_bytes = (uint8_t) _cc.max_read_bytes;
+    }
+
+    _max_write_bytes = MAX_OPERATION_SIZE;
+    if (_cc.max_write_bytes != 0 && _cc.max_write_bytes < MAX_OPERATION_SIZE) {
+        _max_write_bytes = (uint8_t) _cc.max_write_bytes;
+    }
+
+    update_ndef_capacity();
+}
+
+/**
+ * @brief This function sets the NDEF capacity from the CC file, or the system file
+ * memory size when the CC file was not read yet
+ */
+void M24srDriver::update_ndef_capacity() {
+    uint32_t file_size = MAX_NDEF_SIZE;
+
+    /* the CC file gives the size of the NDEF file itself */
+
+    if (_cc_valid && _cc.ndef_file_max_size != 0) {
+        file_size = _cc.ndef_file_max_size;
+    } else if (_system_file_valid) {
+        file_size = (uint32_t) _system_file.memory_size + 1;
+    }
+
+    if (file_size < NDEF_FILE_HEADER_SIZE) {
+        file_size = NDEF_FILE_HEADER_SIZE;
+    }
+
+    _ndef_capacity = (uint16_t) (file_size - NDEF_FILE_HEADER_SIZE);
+}
+
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+/* rewriting this many unchanged bytes costs less EEPROM time than an extra frame */
+#define SHADOW_MERGE_GAP (EEPROM_WRITE_TIME_US / EEPROM_WRITE_TIME_PER_BYTE_US)
+
+/**
+ * @brief This function writes a range to the shadow, only the bytes that change are marked dirty
+ * @param offset  offset in the NDEF message
+ * @param bytes   data to write, NULL to erase
+ * @param count   number of bytes, the range has to fit in the shadow
+ */
+void M24srDriver::shadow_write(uint16_t offset, const uint8_t *bytes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const uint16_t position = (uint16_t) (offset + i);
+        const uint8_t value = bytes ? bytes[i] : 0;
+
+        if (_shadow[position] != value || !is_shadow_valid(position, 1)) {
+            _shadow[position] = value;
+            shadow_mark_dirty(position, true);
+        }
+    }
+
+    shadow_mark_valid(offset, count, true);
+}
+
+/**
+ * @brief This function copies to the shadow a range written directly to the chip
+ * @param offset  offset in the NDEF message
+ * @param bytes   data written, NULL when erased
+ * @param count   number of bytes
+ */
+void M24srDriver::shadow_write_through(uint16_t offset, const uint8_t *bytes, size_t count) {
+    if (offset >= MBED_CONF_M24SR_NDEF_SHADOW_SIZE) {
+        return;
+    }
+
+    if (offset + count > MBED_CONF_M24SR_NDEF_SHADOW_SIZE) {
+        count = MBED_CONF_M24SR_NDEF_SHADOW_SIZE - offset;
+    }
+
+    if (bytes) {
+        memcpy(&_shadow[offset], bytes, count);
+    } else {
+        memset(&_shadow[offset], 0, count);
+    }
+
+    /* the chip content is not known until the write completes */
+    shadow_mark_valid(offset, count, false);
+}
+
+/**
+ * @brief This function merges a range read from the chip with the shadow: the
+ * dirty bytes are copied to the buffer and the others are kept by the shadow
+ * @param offset  offset in the NDEF message
+ * @param bytes   data read from the chip
+ * @param count   number of bytes
+ */
+void M24srDriver::shadow_read(uint16_t offset, uint8_t *bytes, size_t count) {
+    if (offset >= MBED_CONF_M24SR_NDEF_SHADOW_SIZE) {
+        return;
+    }
+
+    if (offset + count > MBED_CONF_M24SR_NDEF_SHADOW_SIZE) {
+        count = MBED_CONF_M24SR_NDEF_SHADOW_SIZE - offset;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (is_shadow_dirty((uint16_t) (offset + i))) {
+            bytes[i] = _shadow[offset + i];
+        } else {
+            _shadow[offset + i] = bytes[i];
+        }
+    }
+
+    shadow_mark_valid(offset, count, true);
+}
+
+/**
+ * @brief This function sets the validity of the blocks of the shadow, a block is
+ * only marked valid when the range covers it entirely
+ * @param offset  offset in the NDEF message
+ * @param count   number of bytes
+ * @param valid   true if the range content matches the chip
+ */
+void M24srDriver::shadow_mark_valid(uint16_t offset, size_t count, bool valid) {
+    size_t first = offset / SHADOW_BLOCK_SIZE;
+    size_t end = (offset + count + SHADOW_BLOCK_SIZE - 1) / SHADOW_BLOCK_SIZE;
+
+    if (valid) {
+        /* partially covered blocks */
+        first = (offset + SHADOW_BLOCK_SIZE - 1) / SHADOW_BLOCK_SIZE;
+        if (offset + count < MBED_CONF_M24SR_NDEF_SHADOW_SIZE) {
+            end = (offset + count) / SHADOW_BLOCK_SIZE;
+        }
+    }
+
+    for (size_t block = first; block < end; block++) {
+        if (valid) {
+            _shadow_valid[block / 8] |= (uint8_t) (1 << (block % 8));
+        } else {
+            _shadow_valid[block / 8] &= (uint8_t) ~(1 << (block % 8));
+        }
     }
 }
 
+/**
+ * @brief This function checks that every block touched by a range is valid
+ * @param offset  offset in the NDEF message
+ * @param count   number of bytes
+ * @return true if the content of the range is known
+ */
+bool M24srDriver::is_shadow_valid(uint16_t offset, size_t count) const {
+    const size_t end = (offset + count + SHADOW_BLOCK_SIZE - 1) / SHADOW_BLOCK_SIZE;
+
+    for (size_t block = offset / SHADOW_BLOCK_SIZE; block < end; block++) {
+        if (!(_shadow_valid[block / 8] & (1 << (block % 8)))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool M24srDriver::is_shadow_dirty(uint16_t offset) const {
+    return (_shadow_dirty[offset / 8] & (1 << (offset % 8))) != 0;
+}
+
+void M24srDriver::shadow_mark_dirty(uint16_t offset, bool dirty) {
+    if (is_shadow_dirty(offset) == dirty) {
+        return;
+    }
+
+    if (dirty) {
+        _shadow_dirty[offset / 8] |= (uint8_t) (1 << (offset % 8));
+        _shadow_dirty_bytes++;
+    } else {
+        _shadow_dirty[offset / 8] &= (uint8_t) ~(1 << (offset % 8));
+        _shadow_dirty_bytes--;
+    }
+}
+
+/**
+ * @brief This function finds the next frame to write: the first dirty run, merged
+ * with the following ones when the bytes in between are known and few enough
+ * @param offset  where to store the offset of the frame in the NDEF message
+ * @param length  where to store the length of the frame
+ * @return false if nothing is dirty
+ */
+bool M24srDriver::next_dirty_range(uint16_t *offset, uint16_t *length) const {
+    uint32_t start = 0;
+
+    while (start < MBED_CONF_M24SR_NDEF_SHADOW_SIZE && !is_shadow_dirty((uint16_t) start)) {
+        start++;
+    }
+
+    if (start == MBED_CONF_M24SR_NDEF_SHADOW_SIZE) {
+        return false;
+    }
+
+    uint32_t limit = start + _max_write_bytes;
+    if (limit > MBED_CONF_M24SR_NDEF_SHADOW_SIZE) {
+        limit = MBED_CONF_M24SR_NDEF_SHADOW_SIZE;
+    }
+
+    uint32_t end = start + 1;
+    uint32_t position = end;
+
+    while (position < limit) {
+        if (is_shadow_dirty((uint16_t) position)) {
+            end = ++position;
+            continue;
+        }
+
+        /* look for the next dirty run within reach */
+        uint32_t gap_end = position;
+        while (gap_end < limit && !is_shadow_dirty((uint16_t) gap_end)) {
+            gap_end++;
+        }
+
+        if (gap_end == limit || gap_end - position > SHADOW_MERGE_GAP
+                || !is_shadow_valid((uint16_t) position, gap_end - position)) {
+            break;
+        }
+
+        position = gap_end;
+    }
+
+    *offset = (uint16_t) start;
+    *length = (uint16_t) (end - start);
+    return true;
+}
+#endif
+
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
+static const uint8_t erased_block[HASH_BLOCK_SIZE] = { 0 };
+
+static uint16_t compute_block_hash(const uint8_t *bytes) {
+    return m24sr_crc16(bytes ? bytes : erased_block, HASH_BLOCK_SIZE);
+}
+
+/**
+ * @brief This function checks if a block already holds the data
+ * @param offset  offset in the NDEF message of the block start
+ * @param bytes   new content of the block, NULL when erased
+ * @return true if the block hash is known and matches
+ */
+bool M24srDriver::is_block_unchanged(uint16_t offset, const uint8_t *bytes) const {
+    const size_t block = offset / HASH_BLOCK_SIZE;
+
+    if (block >= HASH_BLOCKS || !(_block_hash_valid[block / 8] & (1 << (block % 8)))) {
+        return false;
+    }
+
+    return _block_hash[block] == compute_block_hash(bytes);
+}
+
+/**
+ * @brief This function counts the bytes at the start of a range made of whole blocks
+ * that do not change
+ * @param offset  offset in the NDEF message
+ * @param bytes   data to write, NULL to erase
+ * @param count   number of bytes
+ * @return number of bytes that can be skipped
+ */
+size_t M24srDriver::unchanged_length(uint16_t offset, const uint8_t *bytes, size_t count) const {
+    size_t length = 0;
+
+    while ((offset + length) % HASH_BLOCK_SIZE == 0 && count - length >= HASH_BLOCK_SIZE
+            && is_block_unchanged((uint16_t) (offset + length), bytes ? bytes + length : NULL)) {
+        length += HASH_BLOCK_SIZE;
+    }
+
+    return length;
+}
+
+/**
+ * @brief This function counts the bytes at the start of a range before the next
+ * whole block that does not change
+ * @param offset  offset in the NDEF message
+ * @param bytes   data to write, NULL to erase
+ * @param count   number of bytes
+ * @return number of bytes to write
+ */
+size_t M24srDriver::changed_length(uint16_t offset, const uint8_t *bytes, size_t count) const {
+    size_t length = 0;
+
+    while (length < count) {
+        const size_t position = offset + length;
+
+        if (length != 0 && position % HASH_BLOCK_SIZE == 0 && count - length >= HASH_BLOCK_SIZE
+                && is_block_unchanged((uint16_t) position, bytes ? bytes + length : NULL)) {
+            break;
+        }
+
+        length += HASH_BLOCK_SIZE - position % HASH_BLOCK_SIZE;
+    }
+
+    return length < count ? length : count;
+}
+
+/**
+ * @brief This function records the content of a range read or written: whole
+ * blocks get their hash, partially covered blocks are forgotten
+ * @param offset  offset in the NDEF message
+ * @param bytes   content of the range, NULL when erased
+ * @param count   number of bytes
+ * @param known   false if the content of the range is not known, after a failed write
+ */
+void M24srDriver::update_block_hashes(uint16_t offset, const uint8_t *bytes, size_t count, bool known) {
+    const size_t end = offset + count;
+
+    for (size_t block = offset / HASH_BLOCK_SIZE; block * HASH_BLOCK_SIZE < end && block < HASH_BLOCKS; block++) {
+        const size_t start = block * HASH_BLOCK_SIZE;
+
+        if (known && start >= offset && start + HASH_BLOCK_SIZE <= end) {
+            _block_hash[block] = compute_block_hash(bytes ? bytes + (start - offset) : NULL);
+            _block_hash_valid[block / 8] |= (uint8_t) (1 << (block % 8));
+        } else {
+            _block_hash_valid[block / 8] &= (uint8_t) ~(1 << (block % 8));
+        }
+    }
+}
+#endif
+
+/**
+ * @brief This function reads the whole system file with a single command, in sync mode
+ * @retval M24SR_SUCCESS the function is successful.
+ * @retval Status (SW1&SW2)   if operation does not complete for another reason.
+ */
+M24srError_t M24srDriver::read_system_file() {
+    _system_file_valid = false;
+
+    M24srError_t status = select_application();
+    if (status == M24SR_SUCCESS) {
+        status = select_system_file();
+    }
+    if (status == M24SR_SUCCESS) {
+        status = st_read_binary(0x0000, SYSTEM_FILE_LENGTH, _system_file_buffer);
+    }
+    if (status == M24SR_SUCCESS) {
+        decode_system_file();
+    }
+
+    return status;
+}
+
+/**
+ * @brief This function decodes the system file buffer into the snapshot
+ */
+void M24srDriver::decode_system_file() {
+    const uint8_t *file = _system_file_buffer;
+
+    _system_file.length = (uint16_t) ((file[0x00] << 8) | file[0x01]);
+    _system_file.i2c_protect = file[0x02];
+    _system_file.i2c_watchdog = file[0x03];
+    _system_file.gpo = file[SYSTEM_FILE_GPO_OFFSET];
+    _system_file.rf_enable = file[0x06];
+    _system_file.ndef_file_number = file[0x07];
+    memcpy(_system_file.uid, &file[SYSTEM_FILE_UID_OFFSET], UID_LENGTH);
+    _system_file.memory_size = (uint16_t) ((file[0x0F] << 8) | file[0x10]);
+    _system_file.product_code = file[SYSTEM_FILE_PRODUCT_CODE_OFFSET];
+    _system_file_valid = true;
+
+    update_ndef_capacity();
+}
+
 /**
  * @brief This function initialize the M24SR device
  * @return M24SR_SUCCESS if no errors
  */
 M24srError_t M24srDriver::init() {
+    /* called from a sync callback, each step would return before its answer is read */
+    if (_sync_running) {
+        return M24SR_ERROR;
+    }
+
     /* force sync comms to avoid triggering the application with an event */
     _communication_type = SYNC;
 
+    if (_answer_check_event != 0) {
+        event_queue()->cancel(_answer_check_event);
+        _answer_check_event = 0;
+    }
+
+    if (_last_command != NONE) {
+        /* an ASYNC command is in progress, the chip NACKs the session command until it answered */
+        io_poll_i2c(_last_command);
+        _last_command = NONE;
+    }
+
+    /* the operation in progress lost its answer, the set up runs its own */
+    _operation = OPERATION_NONE;
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+    _operation_request = false;
+#endif
+
     /* force to open a i2c session */
     M24srError_t status = get_session(true);
 
@@ -344,15 +1010,44 @@ M24srError_t M24srDriver::init() {
         return status;
     }
 
-    /* leave the gpo always up */
-    if (_gpo_pin.is_connected() != 0) {
-        status = manage_i2c_gpo(HIGH_IMPEDANCE);
-        if (status != M24SR_SUCCESS)
-            return status;
+    /* the cached capability container is only valid for the tag it was read from */
+    if (read_system_file() != M24SR_SUCCESS) {
+        invalidate_capability_container();
+        memset(_cc.uid, 0, UID_LENGTH);
+    } else if (memcmp(_system_file.uid, _cc.uid, UID_LENGTH) != 0) {
+        invalidate_capability_container();
+        memcpy(_cc.uid, _system_file.uid, UID_LENGTH);
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+        /* pending writes were meant for another tag */
+        invalidate_shadow();
+        memset(_shadow_dirty, 0, sizeof(_shadow_dirty));
+        _shadow_dirty_bytes = 0;
+#endif
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
+        invalidate_block_hashes();
+#endif
+    }
+
+    /* the I2C GPO signals the answers in async mode, or to the transport waiting for them
+     * with POLL_GPO, otherwise it is left up */
+    const bool async = _requested_communication_type == ASYNC && is_async_possible() && !_pooled;
+    const bool gpo_poll = is_gpo_poll_possible();
+
+    if (_gpo_pin.is_connected() != 0 || gpo_poll) {
+        const NfcGpoState_t gpo_config = (async || gpo_poll) ? I2C_ANSWER_READY : HIGH_IMPEDANCE;
+
+        if (_system_file_valid && (_system_file.gpo & 0x0F) == gpo_config) {
+            /* already set, the system file is not written again */
+            _i2c_gpo_config = gpo_config;
+        } else {
+            status = manage_i2c_gpo(gpo_config);
+            if (status != M24SR_SUCCESS)
+                return status;
+        }
     }
 
-    if (_rf_disable_pin.is_connected() != 0) {
-        status = manage_rf_gpo(HIGH_IMPEDANCE);
+    if (_rf_disable_pin.is_connected() != 0 || MBED_CONF_M24SR_RF_GPO != HIGH_IMPEDANCE) {
+        status = manage_rf_gpo((NfcGpoState_t) MBED_CONF_M24SR_RF_GPO);
         if (status != M24SR_SUCCESS)
             return status;
     }
@@ -364,31 +1059,390 @@ M24srError_t M24srDriver::init() {
         return status;
     }
 
-    if (_gpo_pin.is_connected() != 0) {
-        _gpo_event_interrupt.enable_irq();
+    if (_gpo_event_interrupt) {
+        _gpo_event_interrupt->enable_irq();
+    }
+
+    if ((async && _i2c_gpo_config == I2C_ANSWER_READY) || _pooled) {
+        _communication_type = ASYNC;
     }
 
     return M24SR_SUCCESS;
 }
 
+M24srError_t M24srDriver::set_communication_mode(Communication_t mode) {
+    /* the pool owns the mode of its drivers */
+    if (_pooled) {
+        return M24SR_ERROR;
+    }
+
+    if (mode == ASYNC && !is_async_possible()) {
+        return M24SR_IO_PIN_NOT_CONNECTED;
+    }
+
+    _requested_communication_type = mode;
+
+    M24srError_t status = init();
+
+    if (status == M24SR_SUCCESS && _communication_type != mode) {
+        status = M24SR_ERROR;
+    }
+
+    return status;
+}
+
+/**
+ * @brief This function returns the typical time the chip needs to answer the command in progress
+ * @retval time in microseconds
+ */
+uint32_t M24srDriver::expected_answer_time() const {
+    return expected_command_time(_last_command, _last_command_data.length);
+}
+
 /**
  * Handle communication if SYNC mode is selected
  * @param status the return error
  * @return true if communication has been handled successfully (or was not needed)
  */
-bool M24srDriver::manage_sync_communication(M24srError_t *status) {
-    if (_communication_type == SYNC) {
-        *status = io_poll_i2c();
-        if (*status == M24SR_SUCCESS) {
-            *status = manage_event();
-        } else {
-            _last_command = NONE;
-            return false;
+bool M24srDriver::manage_sync_communication(M24srError_t *status) {
+    if (_communication_type != SYNC) {
+        /* without GPO the answer is polled for by the owner of the driver, e.g. M24srDriverPool */
+        if (_i2c_gpo_config == I2C_ANSWER_READY && !_pooled) {
+            _answer_start_us = _transport->now_us();
+            arm_answer_check(2 * expected_answer_time() + GPO_FALLBACK_MARGIN_US);
+        }
+        return true;
+    }
+
+    if (_sync_running) {
+        /* sent from a callback, the loop below takes the answer once the callback returned */
+        _sync_pending = true;
+        *status = M24SR_SUCCESS;
+        return true;
+    }
+
+    *status = io_poll_i2c(_last_command);
+    if (*status != M24SR_SUCCESS) {
+        _last_command = NONE;
+        return false;
+    }
+
+    /* run the commands chained by the callbacks one after the other, at a constant stack depth */
+    _sync_running = true;
+    *status = manage_event();
+
+    while (_sync_pending) {
+        _sync_pending = false;
+
+        const M24srError_t poll_status = io_poll_i2c(_last_command);
+        if (poll_status != M24SR_SUCCESS) {
+            /* no answer to read, the chained command fails as the first one would */
+            manage_error(poll_status);
+        } else {
+            manage_event();
+        }
+    }
+
+    _sync_running = false;
+
+    if (_reset_pending) {
+        _reset_pending = false;
+        reset();
+    }
+
+    return true;
+}
+
+/**
+ * @brief This function schedules a poll for the ASYNC answer in progress
+ * @param delay_us  time before the poll
+ */
+void M24srDriver::arm_answer_check(uint32_t delay_us) {
+    if (_answer_check_event != 0) {
+        event_queue()->cancel(_answer_check_event);
+    }
+
+    /* the event queue counts in milliseconds */
+    _answer_check_event = event_queue()->call_in((int) ((delay_us + 999) / 1000), this, &M24srDriver::check_answer);
+}
+
+/**
+ * @brief This function processes the ASYNC answer signalled by a GPO edge
+ */
+void M24srDriver::process_gpo_edge() {
+    do {
+        /* the edges coming from now on post the event again, or are taken by this loop */
+        core_util_atomic_store_bool(&_gpo_event_pending, false);
+        core_util_atomic_store_bool(&_gpo_edge_missed, false);
+        take_gpo_edge();
+    } while (core_util_atomic_load_bool(&_gpo_edge_missed));
+}
+
+/**
+ * @brief This function reads the ASYNC answer a GPO edge signalled, if it is there
+ */
+void M24srDriver::take_gpo_edge() {
+    if (_last_command == NONE) {
+        return;
+    }
+
+    /* an edge left over from an answer found by polling, or from the RF side */
+    if (_transport->poll(_address) != 0) {
+        return;
+    }
+
+    if (_answer_check_event != 0) {
+        event_queue()->cancel(_answer_check_event);
+        _answer_check_event = 0;
+    }
+
+    record_ready(1);
+    _poll_statistics.waits[_last_command]++;
+    manage_event();
+}
+
+/**
+ * @brief This function polls for the ASYNC answer whose GPO edge did not come in time
+ */
+void M24srDriver::check_answer() {
+    _answer_check_event = 0;
+
+    if (_last_command == NONE) {
+        return;
+    }
+
+    const bool timeout = _transport->now_us() - _answer_start_us >= _poll_config.timeout_us;
+
+    _poll_statistics.attempts[_last_command]++;
+    if (!timeout && _transport->poll(_address) != 0) {
+        arm_answer_check(_poll_config.interval_us);
+        return;
+    }
+
+    if (timeout) {
+        _poll_statistics.timeouts[_last_command]++;
+        reset_selection();
+        manage_error(M24SR_IO_ERROR_I2CTIMEOUT);
+        return;
+    }
+
+    _poll_statistics.gpo_fallbacks++;
+    _poll_statistics.waits[_last_command]++;
+    manage_event();
+}
+
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+RequestId_t M24srDriver::submit(const Request_t &request, const RequestCallback_t &callback) {
+    if (_request_count == MBED_CONF_M24SR_REQUEST_QUEUE_SIZE) {
+        return NO_REQUEST;
+    }
+
+    if (++_last_request_id == NO_REQUEST) {
+        _last_request_id++;
+    }
+
+    QueuedRequest_t &slot = _requests[(_request_head + _request_count) % MBED_CONF_M24SR_REQUEST_QUEUE_SIZE];
+    slot.id = _last_request_id;
+    slot.request = request;
+    slot.callback = callback;
+    _request_count++;
+
+    const RequestId_t id = _last_request_id;
+    run_requests();
+    return id;
+}
+
+bool M24srDriver::cancel(RequestId_t id) {
+    if (_request_running && _request.id == id) {
+        switch (_request.request.type) {
+            case REQUEST_READ_BYTES:
+            case REQUEST_WRITE_BYTES:
+            case REQUEST_ERASE_BYTES:
+                _request_cancelled = true;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    for (size_t i = 0; i < _request_count; i++) {
+        if (_requests[(_request_head + i) % MBED_CONF_M24SR_REQUEST_QUEUE_SIZE].id != id) {
+            continue;
+        }
+
+        /* close the gap, the other requests keep their order */
+        for (size_t j = i; j + 1 < _request_count; j++) {
+            _requests[(_request_head + j) % MBED_CONF_M24SR_REQUEST_QUEUE_SIZE] =
+                _requests[(_request_head + j + 1) % MBED_CONF_M24SR_REQUEST_QUEUE_SIZE];
+        }
+        _request_count--;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief This function starts the queued requests until one waits for the chip
+ */
+void M24srDriver::run_requests() {
+    if (_requests_dispatching) {
+        /* called back from a request started below, the loop takes the next one */
+        return;
+    }
+
+    _requests_dispatching = true;
+
+    while (!_request_running && _request_count != 0) {
+        _request = _requests[_request_head];
+        _request_head = (_request_head + 1) % MBED_CONF_M24SR_REQUEST_QUEUE_SIZE;
+        _request_count--;
+
+        _request_running = true;
+        _request_cancelled = false;
+        start_request();
+    }
+
+    _requests_dispatching = false;
+}
+
+/**
+ * @brief This function starts the operation of the request in progress
+ */
+void M24srDriver::start_request() {
+    const Request_t &request = _request.request;
+    M24srError_t status = M24SR_SUCCESS;
+
+    /* the NFCEEPROMDriver operations report to the delegate */
+    switch (request.type) {
+        case REQUEST_START_SESSION:
+            start_session();
+            return;
+        case REQUEST_END_SESSION:
+            end_session();
+            return;
+        case REQUEST_READ_BYTES:
+            read_bytes(request.address, request.buffer, request.count);
+            return;
+        case REQUEST_WRITE_BYTES:
+            write_bytes(request.address, request.data, request.count);
+            return;
+        case REQUEST_ERASE_BYTES:
+            erase_bytes(request.address, request.count);
+            return;
+        case REQUEST_READ_SIZE:
+            read_size();
+            return;
+        case REQUEST_WRITE_SIZE:
+            write_size(request.count);
+            return;
+        default:
+            break;
+    }
+
+    /* the others complete it from finish_operation */
+    _operation_request = true;
+
+    switch (request.type) {
+        case REQUEST_I2C_GPO:
+            /* the answers would be signalled to a driver which can't take them, as set_communication_mode */
+            if (request.gpo == I2C_ANSWER_READY && !is_async_possible()) {
+                status = M24SR_IO_PIN_NOT_CONNECTED;
+                break;
+            }
+            status = manage_i2c_gpo(request.gpo);
+            break;
+        case REQUEST_RF_GPO:
+            status = manage_rf_gpo(request.gpo);
+            break;
+        case REQUEST_ENABLE_READ_PASSWORD:
+            status = enable_read_password(request.password, request.new_password);
+            break;
+        case REQUEST_DISABLE_READ_PASSWORD:
+            status = disable_read_password(request.password);
+            break;
+        case REQUEST_ENABLE_WRITE_PASSWORD:
+            status = enable_write_password(request.password, (uint8_t*) request.new_password);
+            break;
+        case REQUEST_DISABLE_WRITE_PASSWORD:
+            status = disable_write_password(request.password);
+            break;
+        case REQUEST_DISABLE_ALL_PASSWORD:
+            status = disable_all_password(request.password);
+            break;
+        case REQUEST_ENABLE_READ_ONLY:
+            status = enable_read_only(request.password);
+            break;
+        case REQUEST_DISABLE_READ_ONLY:
+            status = disable_read_only(request.password);
+            break;
+        case REQUEST_ENABLE_WRITE_ONLY:
+            status = enable_write_only(request.password);
+            break;
+        case REQUEST_DISABLE_WRITE_ONLY:
+            status = disable_write_only(request.password);
+            break;
+        default:
+            status = M24SR_IO_ERROR_PARAMETER;
+            break;
+    }
+
+    /* the parameter checks fail without calling back */
+    if (status != M24SR_SUCCESS && _request_running) {
+        complete_request(status, 0);
+    }
+}
+
+/**
+ * @brief This function reports the end of the request in progress and starts the next one
+ * @param status  result of the request
+ * @param count  number of bytes transferred or size read
+ */
+void M24srDriver::complete_request(M24srError_t status, size_t count) {
+    const RequestCallback_t callback = _request.callback;
+
+    _request_running = false;
+    _operation_request = false;
+    _request_cancelled = false;
+
+    if (callback) {
+        callback(status, count);
+    }
+
+    run_requests();
+}
+
+/**
+ * @brief This function completes the request in progress and the queued ones with M24SR_IO_ERROR_CANCELLED
+ */
+void M24srDriver::cancel_requests() {
+    /* the requests submitted from the callbacks wait for the set up */
+    const bool dispatching = _requests_dispatching;
+    _requests_dispatching = true;
+
+    if (_request_running) {
+        const RequestCallback_t callback = _request.callback;
+
+        _request_running = false;
+        _request_cancelled = false;
+        if (callback) {
+            callback(M24SR_IO_ERROR_CANCELLED, 0);
         }
     }
 
-    return true;
+    for (size_t count = _request_count; count != 0 && _request_count != 0; count--) {
+        const RequestCallback_t callback = _requests[_request_head].callback;
+
+        _request_head = (_request_head + 1) % MBED_CONF_M24SR_REQUEST_QUEUE_SIZE;
+        _request_count--;
+        if (callback) {
+            callback(M24SR_IO_ERROR_CANCELLED, 0);
+        }
+    }
+
+    _requests_dispatching = dispatching;
 }
+#endif
 
 /**
  * @brief This function sends the FWT extension command (S-Block format)
@@ -411,7 +1465,7 @@ M24srError_t M24srDriver::send_fwt_extension(uint8_t fwt_byte) {
     buffer[length++] = GETMSB(crc16);
 
     /* send the request */
-    status = io_send_i2c_command(length, buffer);
+    status = io_send_i2c_command(UPDATE, length, buffer);
     if (status != M24SR_SUCCESS) {
         return status;
     }
@@ -419,8 +1473,7 @@ M24srError_t M24srDriver::send_fwt_extension(uint8_t fwt_byte) {
     _last_command = UPDATE;
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_updated_binary(this, status, _last_command_data.offset, _last_command_data.data,
-                                          _last_command_data.length);
+        step_done(status);
     }
 
     return status;
@@ -431,20 +1484,23 @@ M24srError_t M24srDriver::send_fwt_extension(uint8_t fwt_byte) {
  * @return M24SR_SUCCESS if no errors
  */
 M24srError_t M24srDriver::deselect() {
-    uint8_t buffer[] = DESELECT_REQUEST_COMMAND;
     M24srError_t status;
 
+    /* the I2C session ends, nothing stays selected */
+    reset_selection();
+
     /* send the request */
-    status = io_send_i2c_command(sizeof(buffer), buffer);
+    status = io_send_i2c_command(DESELECT, sizeof(deselect_frame), deselect_frame);
 
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_deselect(this, status);
+        step_done(status);
+        return status;
     }
 
     _last_command = DESELECT;
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_selected_application(this, status);
+        step_done(status);
     }
 
     return status;
@@ -455,7 +1511,7 @@ M24srError_t M24srDriver::receive_deselect() {
     M24srError_t status;
 
     status = io_receive_i2c_response(sizeof(buffer), buffer);
-    get_callback()->on_deselect(this, status);
+    step_done(status);
 
     return status;
 }
@@ -472,23 +1528,30 @@ M24srError_t M24srDriver::get_session(bool force) {
 
     M24srError_t status;
 
+    /* a new I2C session starts with nothing selected */
+    reset_selection();
+
     if (force) {
-        status = io_send_i2c_command(1, &M24SR_OPENSESSION_COMMAND);
+        status = io_send_i2c_command(GET_SESSION, 1, &M24SR_OPENSESSION_COMMAND);
     } else {
-        status = io_send_i2c_command(1, &M24SR_KILLSESSION_COMMAND);
+        status = io_send_i2c_command(GET_SESSION, 1, &M24SR_KILLSESSION_COMMAND);
     }
 
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_session_open(this, status);
+        step_done(status);
         return status;
     }
 
     /* Insure no access will be done just after open session */
     /* The only way here is to poll I2C to know when M24SR is ready */
     /* GPO can not be use with KillSession command */
-    status = io_poll_i2c();
+    status = io_poll_i2c(GET_SESSION);
+    if (status == M24SR_SUCCESS) {
+        /* there is no response to read, the acknowledge is the answer */
+        record_response(0);
+    }
 
-    get_callback()->on_session_open(this, status);
+    step_done(status);
     return status;
 }
 
@@ -498,26 +1561,24 @@ M24srError_t M24srDriver::get_session(bool force) {
  */
 M24srError_t M24srDriver::select_application() {
     M24srError_t status;
-    uint8_t data_out[] = SELECT_APPLICATION_COMMAND;
-    uint16_t P1_P2 = 0x0400;
-    uint16_t length;
-
-    C_APDU command(C_APDU_CLA_DEFAULT, C_APDU_SELECT_FILE, P1_P2, sizeof(data_out), data_out, 0);
 
-    /* build the I2C command */
-    build_I_block_command(CMD_MASK_SELECT_APPLICATION, &command, _did_byte, &length, _buffer);
+    if (_application_selected) {
+        step_done(M24SR_SUCCESS);
+        return M24SR_SUCCESS;
+    }
 
-    /* send the request */
-    status = io_send_i2c_command(length, _buffer);
+    /* send the request, the frame is built at compile time */
+    status = io_send_i2c_command(SELECT_APPLICATION, sizeof(SelectApplicationFrame::frames[0]),
+                                 SelectApplicationFrame::frames[next_block_number()]);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_selected_application(this, status);
+        step_done(status);
         return status;
     }
 
     _last_command = SELECT_APPLICATION;
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_selected_application(this, status);
+        step_done(status);
     }
 
     return status;
@@ -531,12 +1592,14 @@ M24srError_t M24srDriver::receive_select_application() {
 
     status = io_receive_i2c_response(sizeof(data_in), data_in);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_selected_application(this, status);
+        step_done(status);
         return status;
     }
 
-    status = is_correct_crc_residue(data_in, sizeof(data_in));
-    get_callback()->on_selected_application(this, status);
+    status = check_response(data_in, sizeof(data_in));
+    _application_selected = (status == M24SR_SUCCESS);
+    _selected_file = NO_FILE_SELECTED;
+    step_done(status);
 
     return status;
 }
@@ -546,10 +1609,13 @@ M24srError_t M24srDriver::read_id(uint8_t *nfc_id) {
         return M24SR_ERROR;
     }
 
-    _subcommand_cb = &_read_id_cb;
-    _read_id_cb.set_task(nfc_id);
+    if (_system_file_valid) {
+        *nfc_id = _system_file.product_code;
+        return M24SR_SUCCESS;
+    }
 
-    return select_application();
+    _operation_state.id = nfc_id;
+    return start_operation(OPERATION_READ_ID);
 }
 
 /**
@@ -560,26 +1626,24 @@ M24srError_t M24srDriver::read_id(uint8_t *nfc_id) {
  */
 M24srError_t M24srDriver::select_cc_file() {
     M24srError_t status;
-    uint8_t data_out[] = CC_FILE_ID_BYTES;
-    uint16_t P1_P2 =0x000C;
-    uint16_t length;
-
-    C_APDU command(C_APDU_CLA_DEFAULT, C_APDU_SELECT_FILE, P1_P2, sizeof(data_out), data_out, 0);
 
-    /* build the I2C command */
-    build_I_block_command(CMD_MASK_SELECT_CC_FILE, &command, _did_byte, &length, _buffer);
+    if (_application_selected && _selected_file == CC_FILE_ID) {
+        step_done(M24SR_SUCCESS);
+        return M24SR_SUCCESS;
+    }
 
-    /* send the request */
-    status = io_send_i2c_command(length, _buffer);
+    /* send the request, the frame is built at compile time */
+    status = io_send_i2c_command(SELECT_CC_FILE, sizeof(SelectCCFileFrame::frames[0]),
+                                 SelectCCFileFrame::frames[next_block_number()]);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_selected_cc_file(this, status);
+        step_done(status);
         return status;
     }
 
     _last_command = SELECT_CC_FILE;
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_selected_cc_file(this, status);
+        step_done(status);
     }
 
     return status;
@@ -594,12 +1658,13 @@ M24srError_t M24srDriver::receive_select_cc_file() {
     status = io_receive_i2c_response(sizeof(data_in), data_in);
 
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_selected_cc_file(this, status);
+        step_done(status);
         return status;
     }
 
-    status = is_correct_crc_residue(data_in, sizeof(data_in));
-    get_callback()->on_selected_cc_file(this, status);
+    status = check_response(data_in, sizeof(data_in));
+    _selected_file = (status == M24SR_SUCCESS) ? CC_FILE_ID : NO_FILE_SELECTED;
+    step_done(status);
 
     return status;
 }
@@ -610,27 +1675,25 @@ M24srError_t M24srDriver::receive_select_cc_file() {
  * @retval M24SR_ERROR_I2CTIMEOUT I2C timeout occurred.
  */
 M24srError_t M24srDriver::select_system_file() {
-    uint8_t data_out[] = SYSTEM_FILE_ID_BYTES;
     M24srError_t status;
-    uint16_t P1_P2 = 0x000C;
-    uint16_t length;
 
-    C_APDU command(C_APDU_CLA_DEFAULT, C_APDU_SELECT_FILE, P1_P2, sizeof(data_out), data_out, 0);
-
-    /* build the command */
-    build_I_block_command(CMD_MASK_SELECT_CC_FILE, &command, _did_byte, &length, _buffer);
+    if (_application_selected && _selected_file == SYSTEM_FILE_ID) {
+        step_done(M24SR_SUCCESS);
+        return M24SR_SUCCESS;
+    }
 
-    /* send the request */
-    status = io_send_i2c_command(length, _buffer);
+    /* send the request, the frame is built at compile time */
+    status = io_send_i2c_command(SELECT_SYSTEM_FILE, sizeof(SelectSystemFileFrame::frames[0]),
+                                 SelectSystemFileFrame::frames[next_block_number()]);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_selected_system_file(this, status);
+        step_done(status);
         return status;
     }
 
     _last_command = SELECT_SYSTEM_FILE;
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_selected_system_file(this, status);
+        step_done(status);
     }
 
     return status;
@@ -645,12 +1708,13 @@ M24srError_t M24srDriver::receive_select_system_file() {
     status = io_receive_i2c_response(sizeof(data_in), data_in);
 
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_selected_system_file(this, status);
+        step_done(status);
         return status;
     }
 
-    status = is_correct_crc_residue(data_in, sizeof(data_in));
-    get_callback()->on_selected_system_file(this, status);
+    status = check_response(data_in, sizeof(data_in));
+    _selected_file = (status == M24SR_SUCCESS) ? SYSTEM_FILE_ID : NO_FILE_SELECTED;
+    step_done(status);
 
     return status;
 }
@@ -666,21 +1730,35 @@ M24srError_t M24srDriver::select_ndef_file(uint16_t ndef_file_id) {
     uint16_t P1_P2 = 0x000C;
     uint16_t length;
 
-    C_APDU command(C_APDU_CLA_DEFAULT, C_APDU_SELECT_FILE, P1_P2, sizeof(data_out), data_out, 0);
+    if (_application_selected && _selected_file == ndef_file_id) {
+        step_done(M24SR_SUCCESS);
+        return M24SR_SUCCESS;
+    }
 
-    /* build the I2C command */
-    build_I_block_command(CMD_MASK_SELECT_NDEF_FILE, &command, _did_byte, &length, _buffer);
+    if (ndef_file_id == DEFAULT_NDEF_FILE_ID) {
+        /* send the request, the frame is built at compile time */
+        status = io_send_i2c_command(SELECT_NDEF_FILE, sizeof(SelectDefaultNdefFileFrame::frames[0]),
+                                     SelectDefaultNdefFileFrame::frames[next_block_number()]);
+    } else {
+        C_APDU command(C_APDU_CLA_DEFAULT, C_APDU_SELECT_FILE, P1_P2, sizeof(data_out), data_out, 0);
 
-    /* send the request */
-    status = io_send_i2c_command(length, _buffer);
+        /* build the I2C command */
+        build_command<CMD_MASK_SELECT_NDEF_FILE>(&command, &length);
+
+        /* send the request */
+        status = io_send_i2c_command(SELECT_NDEF_FILE, length, _buffer);
+    }
     if (status != M24SR_SUCCESS) {
+        step_done(status);
         return status;
     }
 
     _last_command = SELECT_NDEF_FILE;
+    /* use the offset to store the file id */
+    _last_command_data.offset = ndef_file_id;
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_selected_ndef_file(this, status);
+        step_done(status);
     }
 
     return status;
@@ -695,12 +1773,13 @@ M24srError_t M24srDriver::receive_select_ndef_file() {
     status = io_receive_i2c_response(sizeof(data_in), data_in);
 
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_selected_ndef_file(this, status);
+        step_done(status);
         return status;
     }
 
-    status = is_correct_crc_residue(data_in, sizeof(data_in));
-    get_callback()->on_selected_ndef_file(this, status);
+    status = check_response(data_in, sizeof(data_in));
+    _selected_file = (status == M24SR_SUCCESS) ? _last_command_data.offset : NO_FILE_SELECTED;
+    step_done(status);
 
     return status;
 }
@@ -723,11 +1802,11 @@ M24srError_t M24srDriver::read_binary(uint16_t offset, uint8_t length, uint8_t *
 
     C_APDU command(C_APDU_CLA_DEFAULT, C_APDU_READ_BINARY, offset, 0, NULL, length);
 
-    build_I_block_command(CMD_MASK_READ_BINARY, &command, _did_byte, &command_length, _buffer);
+    build_command<CMD_MASK_READ_BINARY>(&command, &command_length);
 
-    status = io_send_i2c_command(command_length, _buffer);
+    status = io_send_i2c_command(READ, command_length, _buffer);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_read_byte(this, status, offset, buffer, length);
+        step_done(status);
         return status;
     }
 
@@ -737,7 +1816,7 @@ M24srError_t M24srDriver::read_binary(uint16_t offset, uint8_t length, uint8_t *
     _last_command_data.offset = offset;
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_read_byte(this, status, offset, buffer, length);
+        step_done(status);
     }
 
     return status;
@@ -746,26 +1825,23 @@ M24srError_t M24srDriver::read_binary(uint16_t offset, uint8_t length, uint8_t *
 M24srError_t M24srDriver::receive_read_binary() {
     M24srError_t status;
     const uint16_t length = _last_command_data.length;
-    const uint16_t offset = _last_command_data.offset;
     uint8_t *data = _last_command_data.data;
 
     _last_command = NONE;
 
-    status = io_receive_i2c_response(length + STATUS_RESPONSE_LENGTH, _buffer);
-    if (status != M24SR_SUCCESS) {
-        get_callback()->on_read_byte(this, status, offset, data, length);
-        return status;
-    }
+    /* the data goes straight to the caller buffer, the PCB and the status and CRC around it to the stack.
+     * The whole frame is checked before the read is reported, the buffer content is undefined on error. */
+    uint8_t pcb;
+    uint8_t tail[STATUS_RESPONSE_LENGTH - 1];
+    const M24srFragment_t frame[] = { { &pcb, 1 }, { data, length }, { tail, sizeof(tail) } };
 
-    status = is_correct_crc_residue(_buffer, length + STATUS_RESPONSE_LENGTH);
-    if (status != M24SR_SUCCESS) {
-        get_callback()->on_read_byte(this, status, offset, data, length);
-    } else {
-        /* retrieve the data without SW1 & SW2 as provided as return value of the function */
-        memcpy(_last_command_data.data, &_buffer[1], length);
-        get_callback()->on_read_byte(this, status, offset, data, length);
+    status = io_receive_i2c_response(frame, sizeof(frame) / sizeof(frame[0]));
+    if (status == M24SR_SUCCESS) {
+        status = check_response(frame, sizeof(frame) / sizeof(frame[0]));
     }
 
+    step_done(status);
+
     return status;
 }
 
@@ -787,20 +1863,21 @@ M24srError_t M24srDriver::st_read_binary(uint16_t offset, uint8_t length, uint8_
 
     C_APDU command(C_APDU_CLA_ST, C_APDU_READ_BINARY, offset, 0, NULL, length);
 
-    build_I_block_command(CMD_MASK_READ_BINARY, &command, _did_byte, &command_length, _buffer);
+    build_command<CMD_MASK_READ_BINARY>(&command, &command_length);
 
-    status = io_send_i2c_command(command_length, _buffer);
+    status = io_send_i2c_command(READ, command_length, _buffer);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_read_byte(this, status, offset, buffer, length);
+        step_done(status);
         return status;
     }
 
     _last_command = READ;
     _last_command_data.data = buffer;
     _last_command_data.length = length;
+    _last_command_data.offset = offset;
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_read_byte(this, status, offset, buffer, length);
+        step_done(status);
     }
 
     return status;
@@ -816,29 +1893,45 @@ M24srError_t M24srDriver::st_read_binary(uint16_t offset, uint8_t length, uint8_
  */
 M24srError_t M24srDriver::update_binary(uint16_t offset, uint8_t length, const uint8_t *data) {
     M24srError_t status;
-    uint16_t command_length;
 
     if (length > MAX_OPERATION_SIZE) {
         length = MAX_OPERATION_SIZE;
     }
 
-    C_APDU command(C_APDU_CLA_DEFAULT, C_APDU_UPDATE_BINARY, offset, length, data, 0);
+    if (_prepared_update.header_length == 0 || _prepared_update.offset != offset
+            || _prepared_update.length != length || _prepared_update.data != data) {
+        /* nothing was built while the previous command was running */
+        prepare_update_binary(offset, length, data);
+    }
+
+    /* the payload is sent from the caller memory, between the header and the CRC */
+    const M24srConstFragment_t fragments[] = {
+        { _prepared_update.header, _prepared_update.header_length },
+        { data ? data : erased_payload, length },
+        { _prepared_update.crc, sizeof(_prepared_update.crc) }
+    };
+
+    _prepared_update.header_length = 0;
+    _block_number = !_block_number;
 
-    build_I_block_command(CMD_MASK_UPDATE_BINARY, &command, _did_byte, &command_length, _buffer);
+    /* set before the send, a failed write invalidates the range */
+    _last_command_data.data = (uint8_t*) data;
+    _last_command_data.length = length;
+    _last_command_data.offset = offset;
 
-    status = io_send_i2c_command(command_length, _buffer);
+    status = io_send_i2c_command(UPDATE, fragments, sizeof(fragments) / sizeof(fragments[0]));
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_updated_binary(this, status, offset, (uint8_t*) data, length);
+        step_done(status);
         return status;
     }
 
     _last_command = UPDATE;
-    _last_command_data.data = (uint8_t*) data;
-    _last_command_data.length = length;
-    _last_command_data.offset = offset;
+
+    /* the chip is programming, use the time to get the next command ready */
+    step_sent();
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_updated_binary(this, status, offset, (uint8_t*) data, length);
+        step_done(status);
     }
 
     return status;
@@ -847,15 +1940,12 @@ M24srError_t M24srDriver::update_binary(uint16_t offset, uint8_t length, const u
 M24srError_t M24srDriver::receive_update_binary() {
     uint8_t response[STATUS_RESPONSE_LENGTH];
     M24srError_t status;
-    const uint16_t length = _last_command_data.length;
-    uint8_t *data = _last_command_data.data;
-    const uint16_t offset = _last_command_data.offset;
 
     _last_command = NONE;
 
     status = io_receive_i2c_response(sizeof(response), response);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_updated_binary(this, status, offset, data, length);
+        step_done(status);
         return status;
     }
 
@@ -867,12 +1957,12 @@ M24srError_t M24srDriver::receive_update_binary() {
             status = send_fwt_extension(response[OFFSET_PCB + 1]);
             if (status != M24SR_SUCCESS) {
                 /* abort update */
-                get_callback()->on_updated_binary(this, status, offset, data, length);
+                step_done(status);
             }
         }
     } else {
-        status = is_correct_crc_residue(response, STATUS_RESPONSE_LENGTH);
-        get_callback()->on_updated_binary(this, status, offset, data, length);
+        status = check_response(response, STATUS_RESPONSE_LENGTH);
+        step_done(status);
     }
 
     return status;
@@ -891,28 +1981,25 @@ M24srError_t M24srDriver::verify(PasswordType_t password_type, const uint8_t *pa
 
     /* check the parameters */
     if (password_type > I2C_PASSWORD) {
-        get_callback()->on_verified(this, M24SR_IO_ERROR_PARAMETER, password_type, password);
+        step_done(M24SR_IO_ERROR_PARAMETER);
         return M24SR_IO_ERROR_PARAMETER;
     }
 
     C_APDU command(C_APDU_CLA_DEFAULT, C_APDU_VERIFY, password_type, password ? PASSWORD_LENGTH : 0, NULL , 0);
 
-    uint16_t command_mask = CMD_MASK_VERIFY_BINARY_WO_PWD;
-
+    /* build the I2C command */
     if (password) {
         /* copy the password */
         command.body.data = password;
-        /* build the I2C command */
-        command_mask = CMD_MASK_VERIFY_BINARY_WITH_PWD;
+        build_command<CMD_MASK_VERIFY_BINARY_WITH_PWD>(&command, &length);
+    } else {
+        build_command<CMD_MASK_VERIFY_BINARY_WO_PWD>(&command, &length);
     }
 
-    /* build the I2C command */
-    build_I_block_command(command_mask, &command, _did_byte, &length, _buffer);
-
     /* send the request */
-    status = io_send_i2c_command(length, _buffer);
+    status = io_send_i2c_command(VERIFY, length, _buffer);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_verified(this, status, password_type, password);
+        step_done(status);
         return status;
     }
 
@@ -922,7 +2009,7 @@ M24srError_t M24srDriver::verify(PasswordType_t password_type, const uint8_t *pa
     _last_command_data.offset = password_type;
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_verified(this, status, password_type, password);
+        step_done(status);
     }
 
     return status;
@@ -933,18 +2020,15 @@ M24srError_t M24srDriver::receive_verify() {
     uint8_t respBuffer[STATUS_RESPONSE_LENGTH];
     _last_command = NONE;
 
-    const uint8_t *data = _last_command_data.data;
-    const PasswordType_t type = PasswordType_t(_last_command_data.offset);
-
     status = io_receive_i2c_response(sizeof(respBuffer), respBuffer);
 
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_verified(this, status, type, data);
+        step_done(status);
         return status;
     }
 
-    status = is_correct_crc_residue(respBuffer, STATUS_RESPONSE_LENGTH);
-    get_callback()->on_verified(this, status, type, data);
+    status = check_response(respBuffer, STATUS_RESPONSE_LENGTH);
+    step_done(status);
     return status;
 }
 
@@ -961,19 +2045,19 @@ M24srError_t M24srDriver::change_reference_data(PasswordType_t password_type, co
 
     /* check the parameters */
     if (password_type > I2C_PASSWORD) {
-        get_callback()->on_change_reference_data(this, M24SR_IO_ERROR_PARAMETER, password_type, password);
+        step_done(M24SR_IO_ERROR_PARAMETER);
         return M24SR_IO_ERROR_PARAMETER;
     }
 
     C_APDU command(C_APDU_CLA_DEFAULT, C_APDU_CHANGE, password_type, PASSWORD_LENGTH, password, 0);
 
     /* build the command */
-    build_I_block_command(CMD_MASK_CHANGE_REF_DATA, &command, _did_byte, &length, _buffer);
+    build_command<CMD_MASK_CHANGE_REF_DATA>(&command, &length);
 
     /* send the request */
-    status = io_send_i2c_command(length, _buffer);
+    status = io_send_i2c_command(CHANGE_REFERENCE_DATA, length, _buffer);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_change_reference_data(this, status, password_type, password);
+        step_done(status);
         return status;
     }
 
@@ -983,7 +2067,7 @@ M24srError_t M24srDriver::change_reference_data(PasswordType_t password_type, co
     _last_command_data.offset = password_type;
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_change_reference_data(this, status, password_type, password);
+        step_done(status);
     }
 
     return status;
@@ -993,17 +2077,14 @@ M24srError_t M24srDriver::receive_change_reference_data() {
     M24srError_t status;
     uint8_t rensponse[STATUS_RESPONSE_LENGTH];
 
-    PasswordType_t type = PasswordType_t(_last_command_data.offset);
-    uint8_t *data = _last_command_data.data;
-
     status = io_receive_i2c_response(STATUS_RESPONSE_LENGTH, rensponse);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_change_reference_data(this, status, type, data);
+        step_done(status);
         return status;
     }
 
-    status = is_correct_crc_residue(rensponse, STATUS_RESPONSE_LENGTH);
-    get_callback()->on_change_reference_data(this, status, type, data);
+    status = check_response(rensponse, STATUS_RESPONSE_LENGTH);
+    step_done(status);
     return status;
 }
 
@@ -1019,19 +2100,19 @@ M24srError_t M24srDriver::enable_verification_requirement(PasswordType_t passwor
 
     /* check the parameters */
     if ((password_type != READ_PASSWORD) && (password_type != WRITE_PASSWORD)) {
-        get_callback()->on_enable_verification_requirement(this, M24SR_IO_ERROR_PARAMETER, password_type);
+        step_done(M24SR_IO_ERROR_PARAMETER);
         return M24SR_IO_ERROR_PARAMETER;
     }
 
     C_APDU command(C_APDU_CLA_DEFAULT, C_APDU_ENABLE, password_type, 0, NULL, 0);
 
     /* build the I2C command */
-    build_I_block_command(CMD_MASK_ENABLE_VERIFREQ, &command, _did_byte, &length, _buffer);
+    build_command<CMD_MASK_ENABLE_VERIFREQ>(&command, &length);
 
     /* send the request */
-    status = io_send_i2c_command(length, _buffer);
+    status = io_send_i2c_command(ENABLE_VERIFICATION_REQUIREMENT, length, _buffer);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_enable_verification_requirement(this, status, password_type);
+        step_done(status);
         return status;
     }
 
@@ -1040,7 +2121,7 @@ M24srError_t M24srDriver::enable_verification_requirement(PasswordType_t passwor
     _last_command_data.offset = password_type;
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_enable_verification_requirement(this, status, password_type);
+        step_done(status);
     }
 
     return status;
@@ -1050,16 +2131,14 @@ M24srError_t M24srDriver::receive_enable_verification_requirement() {
     M24srError_t status;
     uint8_t rensponse[STATUS_RESPONSE_LENGTH];
 
-    PasswordType_t type = PasswordType_t(_last_command_data.offset);
-
     status = io_receive_i2c_response(STATUS_RESPONSE_LENGTH, rensponse);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_enable_verification_requirement(this, status, type);
+        step_done(status);
         return status;
     }
 
-    status = is_correct_crc_residue(rensponse, STATUS_RESPONSE_LENGTH);
-    get_callback()->on_enable_verification_requirement(this, status, type);
+    status = check_response(rensponse, STATUS_RESPONSE_LENGTH);
+    step_done(status);
     return status;
 }
 
@@ -1075,19 +2154,19 @@ M24srError_t M24srDriver::disable_verification_requirement(PasswordType_t passwo
 
     /* check the parameters */
     if ((password_type != READ_PASSWORD) && (password_type != WRITE_PASSWORD)) {
-        get_callback()->on_disable_verification_requirement(this, M24SR_IO_ERROR_PARAMETER, password_type);
+        step_done(M24SR_IO_ERROR_PARAMETER);
         return M24SR_IO_ERROR_PARAMETER;
     }
 
     C_APDU command(C_APDU_CLA_DEFAULT, C_APDU_DISABLE, password_type, 0, NULL, 0);
 
     /* build the command */
-    build_I_block_command(CMD_MASK_DISABLE_VERIFREQ, &command, _did_byte, &length, _buffer);
+    build_command<CMD_MASK_DISABLE_VERIFREQ>(&command, &length);
 
     /* send the request */
-    status = io_send_i2c_command(length, _buffer);
+    status = io_send_i2c_command(DISABLE_VERIFICATION_REQUIREMENT, length, _buffer);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_disable_verification_requirement(this, status, password_type);
+        step_done(status);
         return status;
     }
 
@@ -1096,7 +2175,7 @@ M24srError_t M24srDriver::disable_verification_requirement(PasswordType_t passwo
     _last_command_data.offset = password_type;
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_disable_verification_requirement(this, status, password_type);
+        step_done(status);
     }
 
     return status;
@@ -1106,16 +2185,14 @@ M24srError_t M24srDriver::receive_disable_verification_requirement() {
     M24srError_t status;
     uint8_t rensponse[STATUS_RESPONSE_LENGTH];
 
-    PasswordType_t type = PasswordType_t(_last_command_data.offset);
-
     status = io_receive_i2c_response(STATUS_RESPONSE_LENGTH, rensponse);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_disable_verification_requirement(this, status, type);
+        step_done(status);
         return status;
     }
 
-    status = is_correct_crc_residue(rensponse, STATUS_RESPONSE_LENGTH);
-    get_callback()->on_disable_verification_requirement(this, status, type);
+    status = check_response(rensponse, STATUS_RESPONSE_LENGTH);
+    step_done(status);
     return status;
 }
 
@@ -1131,19 +2208,19 @@ M24srError_t M24srDriver::enable_permanent_state(PasswordType_t password_type) {
 
     /* check the parameters */
     if ((password_type != READ_PASSWORD) && (password_type != WRITE_PASSWORD)) {
-        get_callback()->on_enable_permanent_state(this, M24SR_IO_ERROR_PARAMETER, password_type);
+        step_done(M24SR_IO_ERROR_PARAMETER);
         return M24SR_IO_ERROR_PARAMETER;
     }
 
     C_APDU command(C_APDU_CLA_ST, C_APDU_ENABLE, password_type, 0, NULL, 0);
 
     /* build the I2C command */
-    build_I_block_command(CMD_MASK_ENABLE_VERIFREQ, &command, _did_byte, &length, _buffer);
+    build_command<CMD_MASK_ENABLE_VERIFREQ>(&command, &length);
 
     /* send the request */
-    status = io_send_i2c_command(length, _buffer);
+    status = io_send_i2c_command(ENABLE_PERMANET_STATE, length, _buffer);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_enable_permanent_state(this, status, password_type);
+        step_done(status);
         return status;
     }
 
@@ -1152,7 +2229,7 @@ M24srError_t M24srDriver::enable_permanent_state(PasswordType_t password_type) {
     _last_command_data.offset = password_type;
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_enable_permanent_state(this, status, password_type);
+        step_done(status);
     }
 
     return status;
@@ -1162,16 +2239,14 @@ M24srError_t M24srDriver::receive_enable_permanent_state() {
     M24srError_t status;
     uint8_t rensponse[STATUS_RESPONSE_LENGTH];
 
-    PasswordType_t type = PasswordType_t(_last_command_data.offset);
-
     status = io_receive_i2c_response(STATUS_RESPONSE_LENGTH, rensponse);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_enable_permanent_state(this, status, type);
+        step_done(status);
         return status;
     }
 
-    status = is_correct_crc_residue(rensponse, STATUS_RESPONSE_LENGTH);
-    get_callback()->on_enable_permanent_state(this, status, type);
+    status = check_response(rensponse, STATUS_RESPONSE_LENGTH);
+    step_done(status);
     return status;
 }
 
@@ -1187,19 +2262,19 @@ M24srError_t M24srDriver::disable_permanent_state(PasswordType_t password_type)
 
     /* check the parameters */
     if ((password_type != READ_PASSWORD) && (password_type != WRITE_PASSWORD)) {
-        get_callback()->on_disable_permanent_state(this, M24SR_IO_ERROR_PARAMETER, password_type);
+        step_done(M24SR_IO_ERROR_PARAMETER);
         return M24SR_IO_ERROR_PARAMETER;
     }
 
     C_APDU command(C_APDU_CLA_ST, C_APDU_DISABLE, password_type, 0, NULL, 0);
 
     /* build the I2C command */
-    build_I_block_command(CMD_MASK_DISABLE_VERIFREQ, &command, _did_byte, &length, _buffer);
+    build_command<CMD_MASK_DISABLE_VERIFREQ>(&command, &length);
 
     /* send the request */
-    status = io_send_i2c_command(length, _buffer);
+    status = io_send_i2c_command(DISABLE_PERMANET_STATE, length, _buffer);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_enable_permanent_state(this, status, password_type);
+        step_done(status);
         return status;
     }
 
@@ -1208,7 +2283,7 @@ M24srError_t M24srDriver::disable_permanent_state(PasswordType_t password_type)
     _last_command_data.offset = password_type;
 
     if (!manage_sync_communication(&status)) {
-        get_callback()->on_disable_permanent_state(this, status, password_type);
+        step_done(status);
     }
 
     return status;
@@ -1218,16 +2293,14 @@ M24srError_t M24srDriver::receive_disable_permanent_state() {
     M24srError_t status;
     uint8_t rensponse[STATUS_RESPONSE_LENGTH];
 
-    PasswordType_t type = PasswordType_t(_last_command_data.offset);
-
     status = io_receive_i2c_response(STATUS_RESPONSE_LENGTH, rensponse);
     if (status != M24SR_SUCCESS) {
-        get_callback()->on_disable_permanent_state(this, status, type);
+        step_done(status);
         return status;
     }
 
-    status = is_correct_crc_residue(rensponse, STATUS_RESPONSE_LENGTH);
-    get_callback()->on_disable_permanent_state(this, status, type);
+    status = check_response(rensponse, STATUS_RESPONSE_LENGTH);
+    step_done(status);
     return status;
 }
 
@@ -1248,7 +2321,7 @@ M24srError_t M24srDriver::send_interrupt() {
     C_APDU command(C_APDU_CLA_ST, C_APDU_INTERRUPT, P1_P2, 0, NULL, 0);
 
     /* build the I2C command */
-    build_I_block_command(CMD_MASK_SEND_INTERRUPT, &command, _did_byte, &length, _buffer);
+    build_command<CMD_MASK_SEND_INTERRUPT>(&command, &length);
 
     return send_receive_i2c(length, _buffer);
 }
@@ -1257,11 +2330,11 @@ M24srError_t M24srDriver::send_receive_i2c(uint16_t length, uint8_t *buffer) {
     M24srError_t status;
 
     /* send the request */
-    status = io_send_i2c_command(length, buffer);
+    status = io_send_i2c_command(NONE, length, buffer);
     if (status != M24SR_SUCCESS)
         return status;
 
-    status = io_poll_i2c();
+    status = io_poll_i2c(NONE);
     if (status != M24SR_SUCCESS)
         return status;
 
@@ -1270,7 +2343,7 @@ M24srError_t M24srDriver::send_receive_i2c(uint16_t length, uint8_t *buffer) {
     if (status != M24SR_SUCCESS)
         return status;
 
-    return is_correct_crc_residue(buffer, STATUS_RESPONSE_LENGTH);
+    return check_response(buffer, STATUS_RESPONSE_LENGTH);
 }
 
 /**
@@ -1293,13 +2366,14 @@ M24srError_t M24srDriver::state_control(bool gpo_reset) {
     C_APDU command(C_APDU_CLA_ST, C_APDU_INTERRUPT, P1_P2, 1, &reset, 0);
 
     /* build the I2C command */
-    build_I_block_command(CMD_MASK_GPO_STATE, &command, _did_byte, &length, _buffer);
+    build_command<CMD_MASK_GPO_STATE>(&command, &length);
 
     return send_receive_i2c(length, _buffer);
 }
 
 M24srError_t M24srDriver::manage_i2c_gpo(NfcGpoState_t gpo_i2c_config) {
-    if (_gpo_pin.is_connected() == 0) {
+    /* with POLL_GPO the transport may watch the GPO */
+    if (_gpo_pin.is_connected() == 0 && !is_gpo_poll_possible()) {
         return M24SR_IO_PIN_NOT_CONNECTED;
     }
 
@@ -1307,10 +2381,8 @@ M24srError_t M24srDriver::manage_i2c_gpo(NfcGpoState_t gpo_i2c_config) {
         return M24SR_IO_ERROR_PARAMETER;
     }
 
-    _subcommand_cb = &_manage_gpo_cb;
-    _manage_gpo_cb.set_new_gpo_config(true, gpo_i2c_config);
-
-    return select_application();
+    _operation_state.gpo.config = gpo_i2c_config;
+    return start_operation(OPERATION_I2C_GPO);
 }
 
 M24srError_t M24srDriver::manage_rf_gpo(NfcGpoState_t gpo_rf_config) {
@@ -1322,10 +2394,8 @@ M24srError_t M24srDriver::manage_rf_gpo(NfcGpoState_t gpo_rf_config) {
         return M24SR_IO_ERROR_PARAMETER;
     }
 
-    _subcommand_cb = &_manage_gpo_cb;
-    _manage_gpo_cb.set_new_gpo_config(false, gpo_rf_config);
-
-    return select_application();
+    _operation_state.gpo.config = gpo_rf_config;
+    return start_operation(OPERATION_RF_GPO);
 }
 
 M24srError_t M24srDriver::rf_config(bool enable) {
@@ -1338,34 +2408,675 @@ M24srError_t M24srDriver::rf_config(bool enable) {
     return M24SR_SUCCESS;
 }
 
-M24srError_t M24srDriver::io_send_i2c_command(uint8_t length, const uint8_t *buffer) {
-    int ret = _i2c_channel.write(M24SR_ADDR, (const char*) buffer, length);
+M24srError_t M24srDriver::check_response(uint8_t *data, uint8_t length) {
+    return check_status(is_correct_crc_residue(data, length));
+}
+
+M24srError_t M24srDriver::check_response(const M24srFragment_t *fragments, size_t count) {
+    return check_status(is_correct_crc_residue(fragments, count));
+}
+
+M24srError_t M24srDriver::check_status(M24srError_t status) {
+    if (status == M24SR_RF_SESSION_KILLED) {
+        reset_selection();
+        on_rf_activity();
+    }
+
+    if (status != M24SR_SUCCESS) {
+        record_failure();
+    }
+
+    return status;
+}
+
+M24srError_t M24srDriver::io_send_i2c_command(Command_t command_type, uint8_t length, const uint8_t *buffer) {
+    record_send(command_type, length);
+
+    int ret = _transport->write(_address, buffer, length);
+    if (ret == 0) {
+        return M24SR_SUCCESS;
+    }
+
+    /* the chip may have left the session */
+    reset_selection();
+    record_failure();
+    return M24SR_IO_ERROR_I2CTIMEOUT;
+}
+
+M24srError_t M24srDriver::io_send_i2c_command(Command_t command_type, const M24srConstFragment_t *fragments,
+                                              size_t count) {
+    size_t length = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        length += fragments[i].length;
+    }
+
+    record_send(command_type, (uint8_t) length);
+
+    int ret = _transport->write_gather(_address, fragments, count);
     if (ret == 0) {
         return M24SR_SUCCESS;
     }
+
+    /* the chip may have left the session */
+    reset_selection();
+    record_failure();
     return M24SR_IO_ERROR_I2CTIMEOUT;
 }
 
 M24srError_t M24srDriver::io_receive_i2c_response(uint8_t length, uint8_t *buffer) {
-    int ret = _i2c_channel.read(M24SR_ADDR, (char*) buffer, length);
+    int ret = _transport->read(_address, buffer, length);
+    if (ret == 0) {
+        record_response(length);
+        return M24SR_SUCCESS;
+    }
+
+    reset_selection();
+    record_failure();
+    return M24SR_IO_ERROR_I2CTIMEOUT;
+}
+
+M24srError_t M24srDriver::io_receive_i2c_response(const M24srFragment_t *fragments, size_t count) {
+    size_t length = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        length += fragments[i].length;
+    }
+
+    int ret = _transport->read_scatter(_address, fragments, count);
     if (ret == 0) {
+        record_response((uint8_t) length);
         return M24SR_SUCCESS;
     }
 
+    reset_selection();
+    record_failure();
     return M24SR_IO_ERROR_I2CTIMEOUT;
 }
 
-M24srError_t M24srDriver::io_poll_i2c() {
-    int status = 1;
-    while (status != 0) {
+M24srError_t M24srDriver::io_poll_i2c(Command_t command) {
+    const uint64_t start = _transport->now_us();
+    uint64_t elapsed = 0;
+    uint32_t backoff = _poll_config.interval_us;
+    uint32_t delay = 0;
+    uint32_t attempts = 0;
+
+    _poll_statistics.waits[command]++;
+
+    if (_poll_config.strategy == POLL_BACKOFF) {
+        delay = expected_command_time(command, _last_command_data.length);
+    } else if (is_gpo_poll_possible() && _i2c_gpo_config == I2C_ANSWER_READY) {
+        _transport->wait_gpo_edge(_poll_config.timeout_us);
+        elapsed = _transport->now_us() - start;
+    }
+
+    while (true) {
+        if (delay > 0) {
+            if (elapsed + delay > _poll_config.timeout_us) {
+                delay = (uint32_t) (_poll_config.timeout_us - elapsed);
+            }
+            _transport->wait_us(delay);
+        }
+
         /* send the device address and wait to receive an ack bit */
-        status = _i2c_channel.write(M24SR_ADDR, NULL, 0);
+        _poll_statistics.attempts[command]++;
+        attempts++;
+        if (_transport->poll(_address) == 0) {
+            record_ready(attempts);
+            return M24SR_SUCCESS;
+        }
+
+        elapsed = _transport->now_us() - start;
+        if (elapsed >= _poll_config.timeout_us) {
+            _poll_statistics.timeouts[command]++;
+            reset_selection();
+            record_ready(attempts);
+            record_failure();
+            return M24SR_IO_ERROR_I2CTIMEOUT;
+        }
+
+        switch (_poll_config.strategy) {
+        case POLL_SPIN:
+            delay = 0;
+            break;
+        case POLL_BACKOFF:
+            delay = backoff;
+            backoff = (backoff > _poll_config.max_interval_us / 2) ? _poll_config.max_interval_us : backoff * 2;
+            break;
+        default:
+            delay = _poll_config.interval_us;
+            break;
+        }
     }
-    return M24SR_SUCCESS;
 }
 
+/* Each operation is a table of steps, the engine sends the command of a step and moves to the
+ * next one when its answer comes. The first error ends the operation, apart from the retries. */
+
+static constexpr Step_t no_steps[] = {
+    { STEP_END }
+};
+
+/* the CC file is only read for the first session on a tag */
+static constexpr Step_t start_session_steps[] = {
+    { STEP_GET_SESSION },
+    { STEP_SELECT_APPLICATION, 0, SKIP_NEVER, OPEN_SESSION_RETRIES },
+    { STEP_SELECT_CC_FILE, 0, SKIP_IF_CC_CACHED },
+    { STEP_READ_CC_FILE, 0, SKIP_IF_CC_CACHED },
+    { STEP_SELECT_NDEF_FILE },
+    { STEP_END }
+};
+
+static constexpr Step_t end_session_steps[] = {
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+    { STEP_SELECT_NDEF_FILE, 0, SKIP_IF_SHADOW_CLEAN },
+    { STEP_FLUSH_SHADOW, 0, SKIP_IF_SHADOW_CLEAN },
+#endif
+    { STEP_DESELECT },
+    { STEP_END }
+};
+
+static constexpr Step_t read_bytes_steps[] = {
+    { STEP_SELECT_NDEF_FILE },
+    { STEP_READ_CHUNK },
+    { STEP_END }
+};
+
+static constexpr Step_t write_bytes_steps[] = {
+    { STEP_SELECT_NDEF_FILE },
+    { STEP_WRITE_CHUNK },
+    { STEP_END }
+};
+
+static constexpr Step_t write_size_steps[] = {
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+    { STEP_SELECT_NDEF_FILE, 0, SKIP_IF_SHADOW_CLEAN },
+    { STEP_FLUSH_SHADOW, 0, SKIP_IF_SHADOW_CLEAN },
+#endif
+    { STEP_SELECT_NDEF_FILE },
+    { STEP_WRITE_SIZE },
+    { STEP_END }
+};
+
+static constexpr Step_t read_size_steps[] = {
+    { STEP_SELECT_NDEF_FILE },
+    { STEP_READ_SIZE },
+    { STEP_END }
+};
+
+/* the system file is only read if it couldn't be at reset */
+static constexpr Step_t i2c_gpo_steps[] = {
+    { STEP_SELECT_APPLICATION },
+    { STEP_SELECT_SYSTEM_FILE },
+    { STEP_READ_SYSTEM_FILE, 0, SKIP_IF_SYSTEM_FILE_KNOWN },
+    { STEP_VERIFY_DEFAULT_PASSWORD, I2C_PASSWORD },
+    { STEP_UPDATE_I2C_GPO },
+    { STEP_END }
+};
+
+static constexpr Step_t rf_gpo_steps[] = {
+    { STEP_SELECT_APPLICATION },
+    { STEP_SELECT_SYSTEM_FILE },
+    { STEP_READ_SYSTEM_FILE, 0, SKIP_IF_SYSTEM_FILE_KNOWN },
+    { STEP_VERIFY_DEFAULT_PASSWORD, I2C_PASSWORD },
+    { STEP_UPDATE_RF_GPO },
+    { STEP_END }
+};
+
+static constexpr Step_t read_id_steps[] = {
+    { STEP_SELECT_APPLICATION },
+    { STEP_SELECT_SYSTEM_FILE },
+    { STEP_READ_SYSTEM_FILE },
+    { STEP_END }
+};
+
+static constexpr Step_t enable_read_password_steps[] = {
+    { STEP_VERIFY, WRITE_PASSWORD },
+    { STEP_CHANGE_REFERENCE_DATA, READ_PASSWORD },
+    { STEP_ENABLE_PERMANENT_STATE, READ_PASSWORD },
+    { STEP_END }
+};
+
+static constexpr Step_t disable_read_password_steps[] = {
+    { STEP_VERIFY, WRITE_PASSWORD },
+    { STEP_DISABLE_VERIFICATION_REQUIREMENT, READ_PASSWORD },
+    { STEP_END }
+};
+
+static constexpr Step_t enable_write_password_steps[] = {
+    { STEP_VERIFY, WRITE_PASSWORD },
+    { STEP_CHANGE_REFERENCE_DATA, WRITE_PASSWORD },
+    { STEP_ENABLE_PERMANENT_STATE, WRITE_PASSWORD },
+    { STEP_END }
+};
+
+static constexpr Step_t disable_write_password_steps[] = {
+    { STEP_VERIFY, WRITE_PASSWORD },
+    { STEP_DISABLE_VERIFICATION_REQUIREMENT, WRITE_PASSWORD },
+    { STEP_END }
+};
+
+static constexpr Step_t disable_all_password_steps[] = {
+    { STEP_VERIFY, I2C_PASSWORD },
+    { STEP_DISABLE_PERMANENT_STATE, READ_PASSWORD },
+    { STEP_DISABLE_PERMANENT_STATE, WRITE_PASSWORD },
+    { STEP_DISABLE_VERIFICATION_REQUIREMENT, READ_PASSWORD },
+    { STEP_DISABLE_VERIFICATION_REQUIREMENT, WRITE_PASSWORD },
+    { STEP_CHANGE_REFERENCE_DATA, READ_PASSWORD },
+    { STEP_CHANGE_REFERENCE_DATA, WRITE_PASSWORD },
+    { STEP_END }
+};
+
+/* read only: writing needs the permanent state of the write password */
+static constexpr Step_t enable_read_only_steps[] = {
+    { STEP_VERIFY, WRITE_PASSWORD },
+    { STEP_ENABLE_PERMANENT_STATE, WRITE_PASSWORD },
+    { STEP_END }
+};
+
+static constexpr Step_t disable_read_only_steps[] = {
+    { STEP_VERIFY, I2C_PASSWORD },
+    { STEP_DISABLE_PERMANENT_STATE, WRITE_PASSWORD },
+    { STEP_DISABLE_VERIFICATION_REQUIREMENT, WRITE_PASSWORD },
+    { STEP_END }
+};
+
+static constexpr Step_t enable_write_only_steps[] = {
+    { STEP_VERIFY, WRITE_PASSWORD },
+    { STEP_ENABLE_PERMANENT_STATE, READ_PASSWORD },
+    { STEP_END }
+};
+
+static constexpr Step_t disable_write_only_steps[] = {
+    { STEP_VERIFY, I2C_PASSWORD },
+    { STEP_DISABLE_PERMANENT_STATE, READ_PASSWORD },
+    { STEP_DISABLE_VERIFICATION_REQUIREMENT, READ_PASSWORD },
+    { STEP_END }
+};
+
+/* indexed by Operation_t */
+static constexpr const Step_t *operation_steps[] = {
+    no_steps,
+    start_session_steps,
+    end_session_steps,
+    read_bytes_steps,
+    write_bytes_steps,
+    write_size_steps,
+    read_size_steps,
+    i2c_gpo_steps,
+    rf_gpo_steps,
+    read_id_steps,
+    enable_read_password_steps,
+    disable_read_password_steps,
+    enable_write_password_steps,
+    disable_write_password_steps,
+    disable_all_password_steps,
+    enable_read_only_steps,
+    disable_read_only_steps,
+    enable_write_only_steps,
+    disable_write_only_steps
+};
+
+static_assert(sizeof(operation_steps) / sizeof(operation_steps[0]) == OPERATION_COUNT,
+              "one table per operation");
+
+M24srError_t M24srDriver::start_operation(Operation_t operation) {
+    _operation = operation;
+    _step = 0;
+    _step_retries = operation_steps[operation][0].retries;
+
+    return run_step();
+}
+
+M24srError_t M24srDriver::start_password_operation(Operation_t operation, const uint8_t *password,
+                                                   const uint8_t *new_password) {
+    _operation_state.password.password = password;
+    _operation_state.password.new_password = new_password;
+
+    return start_operation(operation);
+}
+
+M24srError_t M24srDriver::run_step() {
+    const Step_t *step = &operation_steps[_operation][_step];
+
+    while (step->action != STEP_END && !prepare_step(*step)) {
+        step++;
+        _step++;
+        _step_retries = step->retries;
+    }
+
+    if (step->action == STEP_END) {
+        finish_operation(M24SR_SUCCESS);
+        return M24SR_SUCCESS;
+    }
+
+    return send_step(*step);
+}
+
+bool M24srDriver::prepare_step(const Step_t &step) {
+    switch (step.skip) {
+    case SKIP_IF_CC_CACHED:
+        if (_cc_valid) {
+            return false;
+        }
+        break;
+    case SKIP_IF_SYSTEM_FILE_KNOWN:
+        if (_system_file_valid) {
+            return false;
+        }
+        break;
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+    case SKIP_IF_SHADOW_CLEAN:
+        if (_shadow_dirty_bytes == 0) {
+            return false;
+        }
+        break;
+#endif
+    default:
+        break;
+    }
+
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
+    if (step.action == STEP_WRITE_CHUNK) {
+        /* blocks already holding the data are reported as written */
+        _operation_state.write.done = write_chunk_start(_operation_state.write.done);
+        return _operation_state.write.done < _operation_state.write.count;
+    }
+#endif
+
+    return true;
+}
+
+M24srError_t M24srDriver::send_step(const Step_t &step) {
+    const PasswordType_t type = (PasswordType_t) step.argument;
+
+    switch (step.action) {
+    case STEP_GET_SESSION:
+        return get_session(_operation_state.session.force);
+    case STEP_DESELECT:
+        return deselect();
+    case STEP_SELECT_APPLICATION:
+        return select_application();
+    case STEP_SELECT_CC_FILE:
+        return select_cc_file();
+    case STEP_SELECT_NDEF_FILE:
+        return select_ndef_file(_cc.ndef_file_id);
+    case STEP_SELECT_SYSTEM_FILE:
+        return select_system_file();
+    case STEP_READ_CC_FILE:
+        return read_binary(0x0000, CC_FILE_LENGTH, _operation_state.session.cc_file);
+    case STEP_READ_SYSTEM_FILE:
+        return st_read_binary(0x0000, SYSTEM_FILE_LENGTH, _system_file_buffer);
+    case STEP_READ_CHUNK: {
+        const size_t done = _operation_state.read.done;
+        size_t length = _operation_state.read.count - done;
+
+        if (length > _max_read_bytes) {
+            length = _max_read_bytes;
+        }
+        return read_binary(_operation_state.read.offset + done, (uint8_t) length, _operation_state.read.bytes + done);
+    }
+    case STEP_WRITE_CHUNK: {
+        const size_t done = _operation_state.write.done;
+
+        return update_binary(_operation_state.write.offset + done, write_chunk_length(done), write_chunk_data(done));
+    }
+    case STEP_READ_SIZE:
+        return read_binary(0, NDEF_FILE_HEADER_SIZE, _ndef_size_buffer);
+    case STEP_WRITE_SIZE:
+        return update_binary(0, NDEF_FILE_HEADER_SIZE, _ndef_size_buffer);
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+    case STEP_FLUSH_SHADOW:
+        next_dirty_range(&_operation_state.flush.offset, &_operation_state.flush.length);
+        return update_binary(NDEF_FILE_HEADER_SIZE + _operation_state.flush.offset,
+                             (uint8_t) _operation_state.flush.length, &_shadow[_operation_state.flush.offset]);
+#endif
+    case STEP_VERIFY:
+        return verify(type, _operation_state.password.password);
+    case STEP_VERIFY_DEFAULT_PASSWORD:
+        return verify(type, default_password);
+    case STEP_CHANGE_REFERENCE_DATA:
+        return change_reference_data(type, _operation_state.password.new_password);
+    case STEP_DISABLE_VERIFICATION_REQUIREMENT:
+        return disable_verification_requirement(type);
+    case STEP_ENABLE_PERMANENT_STATE:
+        return enable_permanent_state(type);
+    case STEP_DISABLE_PERMANENT_STATE:
+        return disable_permanent_state(type);
+    case STEP_UPDATE_I2C_GPO:
+        /* the low nibble of the GPO byte is the I2C GPO, the high one the RF GPO */
+        _operation_state.gpo.value = (_system_file.gpo & 0xF0) | (uint8_t) _operation_state.gpo.config;
+        return update_binary(0x0004, 0x01, &_operation_state.gpo.value);
+    case STEP_UPDATE_RF_GPO:
+        _operation_state.gpo.value = (_system_file.gpo & 0x0F) | (((uint8_t) _operation_state.gpo.config) << 4);
+        return update_binary(0x0004, 0x01, &_operation_state.gpo.value);
+    default:
+        return M24SR_SUCCESS;
+    }
+}
+
+bool M24srDriver::complete_step(const Step_t &step) {
+    switch (step.action) {
+    case STEP_READ_CC_FILE:
+        parse_capability_container(_operation_state.session.cc_file);
+        break;
+    case STEP_READ_SYSTEM_FILE:
+        decode_system_file();
+        break;
+    case STEP_READ_CHUNK:
+        _operation_state.read.done += _last_command_data.length;
+
+        if (_progress_cb) {
+            _progress_cb(_operation_state.read.done, _operation_state.read.count);
+        }
+        return _operation_state.read.done < _operation_state.read.count && !is_transfer_cancelled();
+    case STEP_WRITE_CHUNK: {
+        const size_t done = _operation_state.write.done;
+        const uint16_t offset = _operation_state.write.offset - NDEF_FILE_HEADER_SIZE;
+
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
+        /* include the part of the first block written by the previous chunk */
+        const size_t from = done - (offset + done) % HASH_BLOCK_SIZE;
+        const size_t start = (from > done) ? 0 : from;
+        update_block_hashes(offset + start, write_chunk_data(start), done + _last_command_data.length - start, true);
+#else
+        (void) offset;
+#endif
+
+        _operation_state.write.done = done + _last_command_data.length;
+
+        if (_progress_cb) {
+            _progress_cb(_operation_state.write.done, _operation_state.write.count);
+        }
+        return _operation_state.write.done < _operation_state.write.count && !is_transfer_cancelled();
+    }
+    case STEP_READ_SIZE:
+        /* NDEF file size is BE */
+        _ndef_size = (((uint16_t) _ndef_size_buffer[0]) << 8 | _ndef_size_buffer[1]);
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+        _ndef_size_valid = true;
+#endif
+        break;
+    case STEP_WRITE_SIZE:
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+        _ndef_size_valid = true;
+#endif
+        break;
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+    case STEP_FLUSH_SHADOW:
+        for (uint16_t i = 0; i < _operation_state.flush.length; i++) {
+            shadow_mark_dirty(_operation_state.flush.offset + i, false);
+        }
+        return _shadow_dirty_bytes != 0;
+#endif
+    case STEP_UPDATE_I2C_GPO:
+        /* keep the snapshot in line with the chip, the mode is left to the caller */
+        _system_file.gpo = _operation_state.gpo.value;
+        _i2c_gpo_config = _operation_state.gpo.config;
+        break;
+    case STEP_UPDATE_RF_GPO:
+        _system_file.gpo = _operation_state.gpo.value;
+        _rf_gpo_config = _operation_state.gpo.config;
+        break;
+    default:
+        break;
+    }
+
+    return false;
+}
+
+void M24srDriver::step_done(M24srError_t status) {
+    if (_operation == OPERATION_NONE) {
+        /* sent on its own, e.g. by init which looks at the returned status */
+        return;
+    }
+
+    if (status != M24SR_SUCCESS) {
+        if (_step_retries == 0) {
+            finish_operation(status);
+            return;
+        }
+        _step_retries--;
+    } else if (!complete_step(operation_steps[_operation][_step])) {
+        _step++;
+        _step_retries = operation_steps[_operation][_step].retries;
+    }
+
+    run_step();
+}
+
+void M24srDriver::step_sent() {
+    if (operation_steps[_operation][_step].action != STEP_WRITE_CHUNK) {
+        return;
+    }
+
+    /* build the following chunk while the EEPROM is being programmed */
+    const size_t done = _operation_state.write.done;
+    size_t next = done + write_chunk_length(done);
+
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
+    next = write_chunk_start(next);
+#endif
+
+    if (next < _operation_state.write.count) {
+        prepare_update_binary(_operation_state.write.offset + next, write_chunk_length(next), write_chunk_data(next));
+    }
+}
+
+void M24srDriver::finish_operation(M24srError_t status) {
+    const Operation_t operation = _operation;
+    const StepAction_t action = operation_steps[operation][_step].action;
+    const bool success = (status == M24SR_SUCCESS);
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+    const bool request = _operation_request;
+
+    _operation_request = false;
+#endif
+
+    /* the delegate may start the next operation */
+    _operation = OPERATION_NONE;
+
+    switch (operation) {
+    case OPERATION_START_SESSION:
+        _is_session_open = success;
+        if (action == STEP_SELECT_NDEF_FILE && !success) {
+            /* the cached NDEF file id may be stale, read the CC file next time */
+            invalidate_capability_container();
+        }
+        delegate()->on_session_started(success);
+        break;
+    case OPERATION_END_SESSION:
+        /* after a failed flush the session stays open, so that it can be retried */
+        if (success) {
+            _is_session_open = false;
+        }
+        delegate()->on_session_ended(success);
+        break;
+    case OPERATION_READ_BYTES:
+        if (success) {
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+            shadow_read(_operation_state.read.offset - NDEF_FILE_HEADER_SIZE, _operation_state.read.bytes,
+                        _operation_state.read.done);
+#endif
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
+            update_block_hashes(_operation_state.read.offset - NDEF_FILE_HEADER_SIZE, _operation_state.read.bytes,
+                                _operation_state.read.done, true);
+#endif
+        }
+        delegate()->on_bytes_read(_operation_state.read.done);
+        break;
+    case OPERATION_WRITE_BYTES:
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
+        if (action == STEP_WRITE_CHUNK && !success) {
+            /* the chunk may be partly written */
+            update_block_hashes(_last_command_data.offset - NDEF_FILE_HEADER_SIZE, NULL, _last_command_data.length,
+                                false);
+        }
+#endif
+        report_bytes_written(_operation_state.write.bytes, _operation_state.write.done);
+        break;
+    case OPERATION_WRITE_SIZE:
+        delegate()->on_size_written(success);
+        break;
+    case OPERATION_READ_SIZE:
+        delegate()->on_size_read(success, success ? _ndef_size : 0);
+        break;
+    case OPERATION_READ_ID:
+        if (success) {
+            *_operation_state.id = _system_file.product_code;
+        }
+        break;
+    default:
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+        /* the GPO, password and access changes report to the request that started them */
+        if (!request) {
+            break;
+        }
+        if (operation == OPERATION_I2C_GPO && success && !_pooled) {
+            /* the mode follows the GPO, the next resets keep it */
+            _requested_communication_type = (_i2c_gpo_config == I2C_ANSWER_READY) ? ASYNC : SYNC;
+            _communication_type = _requested_communication_type;
+        }
+        complete_request(status, 0);
+#endif
+        break;
+    }
+}
+
+uint8_t M24srDriver::write_chunk_length(size_t done) {
+    size_t length = _operation_state.write.count - done;
+
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
+    /* stop before the next block that does not change */
+    length = changed_length(_operation_state.write.offset - NDEF_FILE_HEADER_SIZE + done, write_chunk_data(done),
+                            length);
+#endif
+
+    if (length > _max_write_bytes) {
+        length = _max_write_bytes;
+    }
+
+    return (uint8_t) length;
+}
+
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
+size_t M24srDriver::write_chunk_start(size_t done) {
+    if (done >= _operation_state.write.count) {
+        return done;
+    }
+
+    return done + unchanged_length(_operation_state.write.offset - NDEF_FILE_HEADER_SIZE + done, write_chunk_data(done),
+                                   _operation_state.write.count - done);
+}
+#endif
+
 M24srError_t M24srDriver::manage_event() {
-    switch (_last_command) {
+    const Command_t command = _last_command;
+
+    /* the answer is consumed, a callback may send the next command */
+    _last_command = NONE;
+
+    switch (command) {
     case DESELECT:
         return receive_deselect();
     case SELECT_APPLICATION:
@@ -1397,6 +3108,14 @@ M24srError_t M24srDriver::manage_event() {
     }
 }
 
+M24srError_t M24srDriver::manage_error(M24srError_t status) {
+    /* the command is over, the next step may send another one */
+    _last_command = NONE;
+
+    step_done(status);
+    return status;
+}
+
 } //ST
 } //vendor
 } //nfc
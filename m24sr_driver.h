@@ -46,7 +46,10 @@
 #include <mbed.h>
 #include "I2C.h"
 #include "NFCEEPROMDriver.h"
+#include "m24sr_transport.h"
+#include "m24sr_i2c_transport.h"
 #include "EventQueue.h"
+#include "UserAllocatedEvent.h"
 
 #if defined TARGET_DISCO_L475VG_IOT01A
 
@@ -78,8 +81,109 @@ namespace ST {
 
 #define OPEN_SESSION_RETRIES  5
 #define CC_FILE_LENGTH        15
+#define UID_LENGTH            7
+#define SYSTEM_FILE_LENGTH    18
 #define NDEF_FILE_HEADER_SIZE 2
 #define MAX_NDEF_SIZE         0x1FFF
+#define MAX_OPERATION_SIZE    246
+#define MAX_PAYLOAD           241
+/** largest frame built in the command buffer, VERIFY with a password */
+#define COMMAND_BUFFER_SIZE   32
+/** PCB, DID, CLA, INS, P1, P2 and LC of an update binary frame */
+#define UPDATE_HEADER_SIZE    7
+#define NO_FILE_SELECTED      0x0000
+
+/** 8-bit I2C address of the chip, used when none is given to the constructor */
+#ifndef MBED_CONF_M24SR_I2C_ADDRESS
+#define MBED_CONF_M24SR_I2C_ADDRESS     0xAC
+#endif
+
+/** how to wait for the chip answer, see PollStrategy_t */
+#ifndef MBED_CONF_M24SR_POLL_STRATEGY
+#define MBED_CONF_M24SR_POLL_STRATEGY   0
+#endif
+
+/** longest wait for the chip answer */
+#ifndef MBED_CONF_M24SR_POLL_TIMEOUT_US
+#define MBED_CONF_M24SR_POLL_TIMEOUT_US 100000
+#endif
+
+#define POLL_INTERVAL_US      100
+#define POLL_MAX_INTERVAL_US  2000
+
+/** collect per command statistics, see CommandStatistics_t */
+#ifndef MBED_CONF_M24SR_COMMAND_STATISTICS
+#define MBED_CONF_M24SR_COMMAND_STATISTICS 0
+#endif
+
+#define LATENCY_HISTOGRAM_BINS     12
+#define LATENCY_HISTOGRAM_FIRST_US 128
+
+/** size of the RAM image of the NDEF file written back by write_size and end_session, 0 to disable */
+#ifndef MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+#define MBED_CONF_M24SR_NDEF_SHADOW_SIZE 0
+#endif
+
+#define SHADOW_BLOCK_SIZE     16
+
+/** keep a CRC of each block of the NDEF message to skip the writes that change nothing */
+#ifndef MBED_CONF_M24SR_NDEF_BLOCK_HASH
+#define MBED_CONF_M24SR_NDEF_BLOCK_HASH 0
+#endif
+
+#define HASH_BLOCK_SIZE       32
+#define HASH_BLOCKS           ((MAX_NDEF_SIZE + HASH_BLOCK_SIZE - 1) / HASH_BLOCK_SIZE)
+
+/** function of the GPO during RF sessions set at reset, see NfcGpoState_t */
+#ifndef MBED_CONF_M24SR_RF_GPO
+#define MBED_CONF_M24SR_RF_GPO 0
+#endif
+
+/** communication mode set up by reset, see Communication_t */
+#ifndef MBED_CONF_M24SR_COMMUNICATION_MODE
+#define MBED_CONF_M24SR_COMMUNICATION_MODE 0
+#endif
+
+/** margin added to the typical command time before an ASYNC answer is polled for, in case the GPO edge was missed */
+#define GPO_FALLBACK_MARGIN_US 2000
+
+/** number of requests submit can hold besides the one in progress, 0 to disable the queue */
+#ifndef MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+#define MBED_CONF_M24SR_REQUEST_QUEUE_SIZE 4
+#endif
+
+/** id never given to a request, returned by submit when the queue is full */
+#define NO_REQUEST            0
+
+/**
+ * Content of the capability container (CC) file
+ */
+struct CapabilityContainer_t {
+    uint16_t length; /**< size of the CC file */
+    uint8_t mapping_version; /**< NFC Forum mapping version */
+    uint16_t max_read_bytes; /**< MLe, largest READ BINARY */
+    uint16_t max_write_bytes; /**< MLc, largest UPDATE BINARY */
+    uint16_t ndef_file_id; /**< id of the NDEF file */
+    uint16_t ndef_file_max_size; /**< size of the NDEF file, length bytes included */
+    uint8_t read_access; /**< NDEF file read access condition */
+    uint8_t write_access; /**< NDEF file write access condition */
+    uint8_t uid[UID_LENGTH]; /**< UID of the tag this content belongs to */
+};
+
+/**
+ * Content of the ST system file
+ */
+struct SystemFile_t {
+    uint16_t length; /**< size of the system file */
+    uint8_t i2c_protect; /**< I2C protect, 0 when the system file can be written without password */
+    uint8_t i2c_watchdog; /**< I2C watchdog, in 30 ms steps, 0 when disabled */
+    uint8_t gpo; /**< GPO configuration, RF function in the high nibble and I2C in the low one */
+    uint8_t rf_enable; /**< RF enable configuration */
+    uint8_t ndef_file_number; /**< number of NDEF files minus one */
+    uint8_t uid[UID_LENGTH]; /**< UID of the chip */
+    uint16_t memory_size; /**< size of the memory minus one */
+    uint8_t product_code; /**< product code: 0x82, 0x86, 0x85, 0x84 for M24SR02, 04, 16, 64 */
+};
 
 /**
  * User parameter used to invoke a command,
@@ -162,7 +266,8 @@ enum M24srError_t : uint16_t {
     M24SR_IO_ERROR_PARAMETER = 0x0014,
     M24SR_IO_ERROR_NBATEMPT = 0x0015,
     M24SR_IO_NOACKNOWLEDGE = 0x0016,
-    M24SR_IO_PIN_NOT_CONNECTED = 0x0017
+    M24SR_IO_PIN_NOT_CONNECTED = 0x0017,
+    M24SR_IO_ERROR_CANCELLED = 0x0018
 };
 
 /**
@@ -206,240 +311,267 @@ enum Command_t {
     DISABLE_VERIFICATION_REQUIREMENT,
     ENABLE_PERMANET_STATE,
     DISABLE_PERMANET_STATE,
+    GET_SESSION,
 };
 
+/** number of values in Command_t */
+#define COMMAND_COUNT         (GET_SESSION + 1)
+
 /**
- * Communication mode used by this device
+ * Multi-step operation of the driver, each one is a table of steps in m24sr_driver.cpp
  */
-enum Communication_t {
-    SYNC, /**< SYNC wait the command response before returning */
-    ASYNC /**< ASYNC use a callback to notify the end of a command */
+enum Operation_t : uint8_t {
+    OPERATION_NONE,
+    OPERATION_START_SESSION,
+    OPERATION_END_SESSION,
+    OPERATION_READ_BYTES,
+    OPERATION_WRITE_BYTES,
+    OPERATION_WRITE_SIZE,
+    OPERATION_READ_SIZE,
+    OPERATION_I2C_GPO,
+    OPERATION_RF_GPO,
+    OPERATION_READ_ID,
+    OPERATION_ENABLE_READ_PASSWORD,
+    OPERATION_DISABLE_READ_PASSWORD,
+    OPERATION_ENABLE_WRITE_PASSWORD,
+    OPERATION_DISABLE_WRITE_PASSWORD,
+    OPERATION_DISABLE_ALL_PASSWORD,
+    OPERATION_ENABLE_READ_ONLY,
+    OPERATION_DISABLE_READ_ONLY,
+    OPERATION_ENABLE_WRITE_ONLY,
+    OPERATION_DISABLE_WRITE_ONLY
 };
 
+/** number of values in Operation_t */
+#define OPERATION_COUNT       (OPERATION_DISABLE_WRITE_ONLY + 1)
+
 /**
- * Class representing a M24SR component.
- * This component has two operation modes, sync or async.
- * In sync mode each function call returns only after the command has completed.
- * In async mode each function call returns immediately and the answer will be notified
- * through a callback.
- * The default behaviour is sync mode.
- * To enable the async mode ManageI2CGPO(I2C_ANSWER_READY) function must be called.
- * When the component notifies an interrupt user must call  {@link ManageEvent} function.
- * Note that passing a parameter other than I2C_ANSWER_READY to ManageI2CGPO initialize the component in sync mode.
+ * Command sent by a step of an operation
  */
-class M24srDriver : public NFCEEPROMDriver {
-public:
-    /**
-     * Object that contains all the callbacks fired by this class, each command has its own callback.
-     * The callback default implementation is an empty function.
-     */
-    class Callbacks {
-    public:
-        /** called when get_session completes */
-        virtual void on_session_open(M24srDriver *nfc, M24srError_t status) {
-            (void) nfc;
-            (void) status;
-        }
-
-        /** called when deselect completes */
-        virtual void on_deselect(M24srDriver *nfc, M24srError_t status) {
-            (void) nfc;
-            (void) status;
-        }
-
-        /** called when select_application completes */
-        virtual void on_selected_application(M24srDriver *nfc, M24srError_t status) {
-            (void) nfc;
-            (void) status;
-        }
-
-        /** called when select_cc_file completes */
-        virtual void on_selected_cc_file(M24srDriver *nfc, M24srError_t status) {
-            (void) nfc;
-            (void) status;
-        }
-
-        /** called when select_ndef_file completes */
-        virtual void on_selected_ndef_file(M24srDriver *nfc, M24srError_t status) {
-            (void) nfc;
-            (void) status;
-        }
-
-        /** called when select_system_file completes */
-        virtual void on_selected_system_file(M24srDriver *nfc, M24srError_t status) {
-            (void) nfc;
-            (void) status;
-        }
-
-        /** called when read_binary completes */
-        virtual void on_read_byte(M24srDriver *nfc, M24srError_t status, uint16_t offset, uint8_t *bytes_read,
-                                  uint16_t read_count) {
-            (void) nfc;
-            (void) status;
-            (void) offset;
-            (void) bytes_read;
-            (void) read_count;
-        }
-
-        /** called when update_binary completes */
-        virtual void on_updated_binary(M24srDriver *nfc, M24srError_t status, uint16_t offset, uint8_t *bytes_written,
-                                       uint16_t write_count) {
-            (void) nfc;
-            (void) status;
-            (void) bytes_written;
-            (void) write_count;
-            (void) offset;
-        }
-
-        /** called when verify completes */
-        virtual void on_verified(M24srDriver *nfc, M24srError_t status, PasswordType_t password_type, const uint8_t *pwd) {
-            (void) nfc;
-            (void) status;
-            (void) password_type;
-            (void) pwd;
-        }
-
-        /** called when manage_i2c_gpo completes */
-        virtual void on_manage_i2c_gpo(M24srDriver *nfc, M24srError_t status, NfcGpoState_t new_status) {
-            (void) nfc;
-            (void) status;
-            (void) new_status;
-        }
-
-        /** called when manage_rf_gpo completes */
-        virtual void on_manage_rf_gpo(M24srDriver *nfc, M24srError_t status, NfcGpoState_t new_status) {
-            (void) nfc;
-            (void) status;
-            (void) new_status;
-        }
-
-        /** called when change_reference_data completes */
-        virtual void on_change_reference_data(M24srDriver *nfc, M24srError_t status, PasswordType_t type,
-                                              const uint8_t *data) {
-            (void) nfc;
-            (void) status;
-            (void) type;
-            (void) data;
-        }
-
-        /** called when enable_verification_requirement completes */
-        virtual void on_enable_verification_requirement(M24srDriver *nfc, M24srError_t status, PasswordType_t type) {
-            (void) nfc;
-            (void) status;
-            (void) type;
-        }
-
-        /** called when disable_verification_requirement completes */
-        virtual void on_disable_verification_requirement(M24srDriver *nfc, M24srError_t status, PasswordType_t type) {
-            (void) nfc;
-            (void) status;
-            (void) type;
-        }
-
-        /** called when enable_permanent_state completes */
-        virtual void on_enable_permanent_state(M24srDriver *nfc, M24srError_t status, PasswordType_t type) {
-            (void) nfc;
-            (void) status;
-            (void) type;
-        }
+enum StepAction_t : uint8_t {
+    STEP_END, /**< last entry of a table, the operation succeeded */
+    STEP_GET_SESSION,
+    STEP_DESELECT,
+    STEP_SELECT_APPLICATION,
+    STEP_SELECT_CC_FILE,
+    STEP_SELECT_NDEF_FILE,
+    STEP_SELECT_SYSTEM_FILE,
+    STEP_READ_CC_FILE,
+    STEP_READ_SYSTEM_FILE,
+    STEP_READ_CHUNK, /**< sent again until the range is read */
+    STEP_WRITE_CHUNK, /**< sent again until the range is written */
+    STEP_READ_SIZE,
+    STEP_WRITE_SIZE,
+    STEP_FLUSH_SHADOW, /**< sent again until the shadow is clean */
+    STEP_VERIFY, /**< with the password given to the operation */
+    STEP_VERIFY_DEFAULT_PASSWORD,
+    STEP_CHANGE_REFERENCE_DATA, /**< to the new password given to the operation */
+    STEP_DISABLE_VERIFICATION_REQUIREMENT,
+    STEP_ENABLE_PERMANENT_STATE,
+    STEP_DISABLE_PERMANENT_STATE,
+    STEP_UPDATE_I2C_GPO,
+    STEP_UPDATE_RF_GPO
+};
 
-        /** called when disable_permanent_state completes */
-        virtual void on_disable_permanent_state(M24srDriver *nfc, M24srError_t status, PasswordType_t type) {
-            (void) nfc;
-            (void) status;
-            (void) type;
-        }
+/**
+ * When a step is skipped, without sending its command
+ */
+enum StepSkip_t : uint8_t {
+    SKIP_NEVER,
+    SKIP_IF_CC_CACHED, /**< the capability container was already read */
+    SKIP_IF_SYSTEM_FILE_KNOWN, /**< the system file was already read */
+    SKIP_IF_SHADOW_CLEAN /**< the shadow has no bytes to write */
+};
 
-        /** called when read_id completes */
-        virtual void on_read_id(M24srDriver *nfc, M24srError_t status, uint8_t *id) {
-            (void) nfc;
-            (void) status;
-            (void) id;
-        }
+/**
+ * Entry of an operation table
+ */
+struct Step_t {
+    StepAction_t action; /**< command to send */
+    uint8_t argument; /**< password type of the password commands */
+    StepSkip_t skip; /**< condition to skip the step */
+    uint8_t retries; /**< number of times the command is sent again when it fails */
+};
 
-        /** called when enable_read_password completes */
-        virtual void on_enable_read_password(M24srDriver *nfc, M24srError_t status, const uint8_t *new_password) {
-            (void) nfc;
-            (void) status;
-            (void) new_password;
-        }
+/**
+ * Communication mode used by this device
+ */
+enum Communication_t {
+    SYNC, /**< SYNC wait the command response before returning */
+    ASYNC /**< ASYNC use a callback to notify the end of a command */
+};
 
-        /** called when oenable_write_password completes */
-        virtual void on_enable_write_password(M24srDriver *nfc, M24srError_t status, const uint8_t *new_password) {
-            (void) nfc;
-            (void) status;
-            (void) new_password;
-        }
+/**
+ * How the driver waits for the chip to answer in SYNC mode
+ */
+enum PollStrategy_t {
+    POLL_SPIN = 0, /**< poll the address back to back */
+    POLL_SLEEP = 1, /**< poll the address at a fixed interval */
+    POLL_BACKOFF = 2, /**< wait the expected command time, then poll with a doubling interval */
+    POLL_GPO = 3 /**< wait for a GPO edge, poll at a fixed interval if the transport can't see the GPO */
+};
 
-        /** called when disable_read_password completes */
-        virtual void on_disable_read_password(M24srDriver *nfc, M24srError_t status) {
-            (void) nfc;
-            (void) status;
-        }
+/**
+ * Parameters of the wait for the chip answer
+ */
+struct PollConfig_t {
+    PollStrategy_t strategy; /**< how to wait */
+    uint32_t timeout_us; /**< give up with M24SR_IO_ERROR_I2CTIMEOUT after this time */
+    uint32_t interval_us; /**< interval of POLL_SLEEP and POLL_GPO, first interval of POLL_BACKOFF */
+    uint32_t max_interval_us; /**< longest interval of POLL_BACKOFF */
+};
 
-        /** called when disable_write_password completes */
-        virtual void on_disable_write_password(M24srDriver *nfc, M24srError_t status) {
-            (void) nfc;
-            (void) status;
-        }
+/**
+ * Counters of the waits for the chip answer, indexed by Command_t
+ */
+struct PollStatistics_t {
+    uint32_t waits[COMMAND_COUNT]; /**< number of waits */
+    uint32_t attempts[COMMAND_COUNT]; /**< address polls sent */
+    uint32_t timeouts[COMMAND_COUNT]; /**< waits that gave up */
+    uint32_t gpo_fallbacks; /**< ASYNC answers found by polling because no GPO edge came in time */
+};
 
-        /** called when disable_all_password completes */
-        virtual void on_disable_all_password(M24srDriver *nfc, M24srError_t status) {
-            (void) nfc;
-            (void) status;
-        }
+/**
+ * Counters of the GPO edges handed from the interrupt to the event queue in ASYNC mode
+ */
+struct GpoEventStatistics_t {
+    uint32_t edges; /**< falling edges seen by the interrupt */
+    uint32_t coalesced; /**< edges merged into the event already waiting to be processed */
+    uint32_t dropped; /**< edges that came while the event was running, taken by it or else by the answer check */
+};
 
-        /** called when enable_read_only completes */
-        virtual void on_enable_read_only(M24srDriver *nfc, M24srError_t status) {
-            (void) nfc;
-            (void) status;
-        }
+/**
+ * Counters of the frames exchanged for one command, a frame is timed from the start
+ * of the send to the end of the response read
+ */
+struct CommandStatistics_t {
+    uint32_t count; /**< frames sent */
+    uint32_t failures; /**< frames that ended with an I/O error, a timeout or an error status */
+    uint32_t bytes_sent; /**< bytes written on the bus */
+    uint32_t bytes_received; /**< bytes read from the bus */
+    uint32_t polls; /**< address polls sent while waiting for the chip */
+    uint64_t ready_time_us; /**< total time between the send and the chip being ready */
+    uint64_t total_time_us; /**< total time between the send and the end of the response */
+    uint32_t max_latency_us; /**< longest frame */
+    /** bin n counts the frames shorter than LATENCY_HISTOGRAM_FIRST_US << n, the last bin all the longer ones */
+    uint32_t latency_histogram[LATENCY_HISTOGRAM_BINS];
+};
 
-        /** called when enable_write_only completes */
-        virtual void on_enable_write_only(M24srDriver *nfc, M24srError_t status) {
-            (void) nfc;
-            (void) status;
-        }
+/**
+ * Operations accepted by the request queue, each one behaves as the driver method of the same name
+ */
+enum RequestType_t {
+    REQUEST_START_SESSION,
+    REQUEST_END_SESSION,
+    REQUEST_READ_BYTES, /**< address, count, buffer */
+    REQUEST_WRITE_BYTES, /**< address, count, data */
+    REQUEST_ERASE_BYTES, /**< address, count */
+    REQUEST_READ_SIZE,
+    REQUEST_WRITE_SIZE, /**< count */
+    REQUEST_I2C_GPO, /**< gpo, selects ASYNC for I2C_ANSWER_READY and SYNC otherwise, as set_communication_mode */
+    REQUEST_RF_GPO, /**< gpo */
+    REQUEST_ENABLE_READ_PASSWORD, /**< password (write password), new_password */
+    REQUEST_DISABLE_READ_PASSWORD, /**< password (write password) */
+    REQUEST_ENABLE_WRITE_PASSWORD, /**< password (write password), new_password */
+    REQUEST_DISABLE_WRITE_PASSWORD, /**< password (write password) */
+    REQUEST_DISABLE_ALL_PASSWORD, /**< password (I2C super user password) */
+    REQUEST_ENABLE_READ_ONLY, /**< password (write password) */
+    REQUEST_DISABLE_READ_ONLY, /**< password (I2C password) */
+    REQUEST_ENABLE_WRITE_ONLY, /**< password (write password) */
+    REQUEST_DISABLE_WRITE_ONLY /**< password (I2C password) */
+};
 
-        /** called when disable_read_only completes */
-        virtual void on_disable_read_only(M24srDriver *nfc, M24srError_t status) {
-            (void) nfc;
-            (void) status;
-        }
+/**
+ * Operation to run from the request queue, the fields not used by the type are ignored.
+ * The buffers and passwords must stay valid until the request completes.
+ */
+struct Request_t {
+    RequestType_t type; /**< operation */
+    uint32_t address; /**< offset in the NDEF message of the byte requests */
+    size_t count; /**< number of bytes of the byte requests, new size of REQUEST_WRITE_SIZE */
+    uint8_t *buffer; /**< where REQUEST_READ_BYTES stores the data */
+    const uint8_t *data; /**< data written by REQUEST_WRITE_BYTES */
+    const uint8_t *password; /**< current password of the password and access requests, 16 bytes */
+    const uint8_t *new_password; /**< password set by the enable password requests, 16 bytes */
+    NfcGpoState_t gpo; /**< new function of the GPO requests */
+};
 
-        /** called when disable_write_only completes */
-        virtual void on_disable_write_only(M24srDriver *nfc, M24srError_t status) {
-            (void) nfc;
-            (void) status;
-        }
+/** identifies a submitted request, never NO_REQUEST */
+typedef uint32_t RequestId_t;
 
-        virtual ~Callbacks() { }
-    };
+/**
+ * Called when a request completes, with M24SR_SUCCESS or the error status, and the number
+ * of bytes transferred for the byte requests or the size read by REQUEST_READ_SIZE.
+ * The NFCEEPROMDriver operations only report a success flag, their failures are M24SR_ERROR,
+ * as are byte requests that transferred fewer bytes than requested.
+ */
+typedef mbed::Callback<void(M24srError_t status, size_t count)> RequestCallback_t;
 
+/**
+ * Class representing a M24SR component.
+ * This component has two operation modes, sync or async.
+ * In sync mode each function call returns only after the command has completed.
+ * In async mode each function call returns immediately and the answer will be notified
+ * through a callback.
+ * The mode is selected with set_communication_mode, or communication_mode in mbed_lib.json,
+ * and set up by reset. The async mode needs the GPO pin and an event queue: the GPO signals
+ * the answers and they are processed from the event queue.
+ */
+class M24srDriver : public NFCEEPROMDriver {
 public:
     /** Create the driver, default pin names will be used appropriate for the board.
      *  @param i2c_data_pin I2C data pin name.
      *  @param i2c_clock_pin I2C clock pin name.
      *  @param gpo_pin I2C GPO pin name.
      *  @param rf_disable_pin pin name for breaking the RF connection.
+     *  @param address 8-bit I2C address of the chip.
      */
     M24srDriver(PinName i2c_data_pin = M24SR_I2C_SDA_PIN, PinName i2c_clock_pin = M24SR_I2C_SCL_PIN,
-                PinName gpo_pin = M24SR_GPO_PIN, PinName rf_disable_pin = M24SR_RF_DISABLE_PIN);
+                PinName gpo_pin = M24SR_GPO_PIN, PinName rf_disable_pin = M24SR_RF_DISABLE_PIN,
+                uint8_t address = MBED_CONF_M24SR_I2C_ADDRESS);
+
+    /** Create the driver on top of an existing transport, e.g. a host I2C adapter.
+     *  GPO and RF disable pins are optional in this case.
+     *  @param transport link to the chip, must outlive the driver.
+     *  @param gpo_pin I2C GPO pin name.
+     *  @param rf_disable_pin pin name for breaking the RF connection.
+     *  @param address 8-bit I2C address of the chip, several chips can share a transport.
+     */
+    M24srDriver(M24srTransport &transport, PinName gpo_pin = NC, PinName rf_disable_pin = NC,
+                uint8_t address = MBED_CONF_M24SR_I2C_ADDRESS);
 
-    virtual ~M24srDriver() { }
+    virtual ~M24srDriver();
 
     /** @see NFCEEPROMDriver::reset
+     *  Called from a delegate or callback in SYNC mode, the reset runs once the
+     *  commands in progress are complete. The queued requests, and the one in
+     *  progress, complete with M24SR_IO_ERROR_CANCELLED.
      */
     virtual void reset() {
-        set_callback(&_default_cb);
+        if (_sync_running) {
+            /* the set up waits for its answers, it can't run inside the loop taking them */
+            _reset_pending = true;
+            return;
+        }
+
+        /* the set up closes the session */
+        _is_session_open = false;
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+        cancel_requests();
+#endif
         init();
-        manage_i2c_gpo(I2C_ANSWER_READY);
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+        /* the requests submitted by the cancelled ones */
+        run_requests();
+#endif
     }
 
     /** @see NFCEEPROMDriver::get_max_size
+     *  The size is detected from the system file at reset and from the CC file
+     *  when the first session is opened, MAX_NDEF_SIZE is assumed until then.
      */
     virtual size_t read_max_size() {
-        return MAX_NDEF_SIZE;
+        return _ndef_capacity;
     }
 
     /** @see NFCEEPROMDriver::start_session
@@ -450,19 +582,20 @@ public:
             return;
         }
 
-        set_callback(&_open_session_cb);
-
-        get_session(force);
+        _operation_state.session.force = force;
+        start_operation(OPERATION_START_SESSION);
     }
 
     /** @see NFCEEPROMDriver::end_session
      */
     virtual void end_session() {
-        set_callback(&_close_session_cb);
-        deselect();
+        /* the shadow is written first */
+        start_operation(OPERATION_END_SESSION);
     }
 
     /** @see NFCEEPROMDriver::read_bytes
+     *  Ranges larger than a single READ BINARY are read in several chunks by the
+     *  driver, on_bytes_read is called once when the whole range has been read.
      */
     virtual void read_bytes(uint32_t address, uint8_t* bytes, size_t count) {
         if (!_is_session_open) {
@@ -470,19 +603,15 @@ public:
             return;
         }
 
-        if (address > _ndef_size) {
+        check_rf_activity();
+
+        if (address > _ndef_capacity) {
             delegate()->on_bytes_read(0);
             return;
         }
 
-        set_callback(&_read_byte_cb);
-
-        if (count > _max_read_bytes) {
-            count = _max_read_bytes;
-        }
-
-        if (address + count > _ndef_size) {
-            count = _ndef_size - address;
+        if (address + count > _ndef_capacity) {
+            count = _ndef_capacity - address;
         }
 
         if (count == 0) {
@@ -490,48 +619,75 @@ public:
             return;
         }
 
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+        if (address + count <= MBED_CONF_M24SR_NDEF_SHADOW_SIZE && is_shadow_valid((uint16_t) address, count)) {
+            /* the shadow holds the content of the chip, with the pending writes */
+            memcpy(bytes, &_shadow[address], count);
+            delegate()->on_bytes_read(count);
+            return;
+        }
+#endif
+
         /* offset by ndef file size*/
         address += NDEF_FILE_HEADER_SIZE;
 
-        read_binary((uint16_t) address, (uint8_t) count, bytes);
+        _operation_state.read.offset = (uint16_t) address;
+        _operation_state.read.bytes = bytes;
+        _operation_state.read.count = count;
+        _operation_state.read.done = 0;
+
+        /* nothing is sent if the NDEF file is still selected */
+        start_operation(OPERATION_READ_BYTES);
     }
 
     /** @see NFCEEPROMDriver::write_bytes
+     *  Ranges larger than a single UPDATE BINARY are written in several chunks by the
+     *  driver, on_bytes_written is called once when the whole range has been written.
      */
     virtual void write_bytes(uint32_t address, const uint8_t* bytes, size_t count) {
         if (!_is_session_open) {
-            delegate()->on_bytes_written(0);
+            report_bytes_written(bytes, 0);
             return;
         }
 
-        if (address > _ndef_size) {
-            delegate()->on_bytes_written(0);
-            return;
-        }
+        check_rf_activity();
 
-        if (bytes) {
-            set_callback(&_write_byte_cb);
-        } else {
-            set_callback(&_erase_bytes_cb);
+        if (address > _ndef_capacity) {
+            report_bytes_written(bytes, 0);
+            return;
         }
 
-        if (count > _max_write_bytes) {
-            count = _max_write_bytes;
+        if (address + count > _ndef_capacity) {
+            count = _ndef_capacity - address;
         }
 
-        if (address + count > _ndef_size) {
-            count = _ndef_size - address;
+        if (count == 0) {
+            report_bytes_written(bytes, 0);
+            return;
         }
 
-        if (count == 0) {
-            delegate()->on_bytes_written(0);
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+        if (address + count <= MBED_CONF_M24SR_NDEF_SHADOW_SIZE) {
+            /* written to the chip by the next write_size or end_session */
+            shadow_write((uint16_t) address, bytes, count);
+            report_bytes_written(bytes, count);
             return;
         }
 
+        /* keep the shadow in line with what is written through */
+        shadow_write_through((uint16_t) address, bytes, count);
+#endif
+
         /* offset by ndef file size*/
         address += NDEF_FILE_HEADER_SIZE;
 
-        update_binary((uint16_t) address, (uint8_t) count, bytes);
+        _operation_state.write.offset = (uint16_t) address;
+        _operation_state.write.bytes = bytes;
+        _operation_state.write.count = count;
+        _operation_state.write.done = 0;
+
+        /* nothing is sent if the NDEF file is still selected */
+        start_operation(OPERATION_WRITE_BYTES);
     }
 
     /** @see NFCEEPROMDriver::set_size
@@ -542,21 +698,23 @@ public:
             return;
         }
 
-        if (count > MAX_NDEF_SIZE - NDEF_FILE_HEADER_SIZE) {
+        if (count > _ndef_capacity) {
             delegate()->on_size_read(false, 0);
             return;
         }
 
-        set_callback(&_set_size_cb);
-
         _ndef_size = (uint16_t)count;
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+        _ndef_size_valid = false;
+#endif
 
         /* NDEF file size is BE */
         uint8_t* bytes = (uint8_t*)&_ndef_size;
         _ndef_size_buffer[0] = bytes[1];
         _ndef_size_buffer[1] = bytes[0];
 
-        update_binary(0, NDEF_FILE_HEADER_SIZE, (const uint8_t*)&_ndef_size_buffer);
+        /* the message has to be complete before its size is written, the shadow is written first */
+        start_operation(OPERATION_WRITE_SIZE);
     }
 
     /** @see NFCEEPROMDriver::get_size
@@ -567,9 +725,16 @@ public:
             return;
         }
 
-        set_callback(&_get_size_cb);
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+        check_rf_activity();
+
+        if (_ndef_size_valid) {
+            delegate()->on_size_read(true, _ndef_size);
+            return;
+        }
+#endif
 
-        read_binary(0, NDEF_FILE_HEADER_SIZE, (uint8_t*)&_ndef_size_buffer);
+        start_operation(OPERATION_READ_SIZE);
     }
 
     /** @see NFCEEPROMDriver::erase_bytes
@@ -578,161 +743,496 @@ public:
         write_bytes(address, NULL, size);
     }
 
-private:
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
     /**
-     * Change the function to call when a command ends.
-     * @param commandCallback Object containing the callback, if NULL it will use empty callback
+     * Forget the content of the NDEF file known by the shadow, bytes written to the
+     * shadow and not flushed yet are kept. This is done automatically when the GPO
+     * reports RF activity (rf_gpo set to SESSION_OPENED or WIP), or when the RF side
+     * kills the I2C session, otherwise call it after the tag was written from the RF side.
      */
-    void set_callback(Callbacks *callback) {
-        if (callback) {
-            _command_cb = callback;
-        } else {
-            _command_cb = &_default_cb;
-        }
+    void invalidate_shadow() {
+        memset(_shadow_valid, 0, sizeof(_shadow_valid));
+        _ndef_size_valid = false;
     }
+#endif
 
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
     /**
-     * get the callback object to use
-     * @return callback object to use
+     * Forget the block hashes of the NDEF message, the next writes are all sent.
+     * This is done automatically in the same cases as invalidate_shadow.
      */
-    Callbacks *get_callback() {
-        /* this allows for two levels of operation, the previous command will continue
-         * when this set of callbacks has finished */
-        if (_subcommand_cb) {
-            return _subcommand_cb;
-        }
-        return _command_cb;
+    void invalidate_block_hashes() {
+        memset(_block_hash_valid, 0, sizeof(_block_hash_valid));
     }
+#endif
 
-    void nfc_interrupt_callback() {
-        if (_communication_type == ASYNC) {
-            event_queue()->call(this, &M24srDriver::manage_event);
-        }
+    /**
+     * Set a function called after each chunk of a multi-chunk transfer.
+     * @param progress_cb Called with the number of bytes transferred so far and
+     * the total number of bytes of the transfer, an empty callback disables it.
+     */
+    void set_progress_callback(mbed::Callback<void(size_t, size_t)> progress_cb) {
+        _progress_cb = progress_cb;
     }
 
     /**
-     * Enable the request of a password before reading the tag.
-     * @param current_write_password Current password
-     * @param new_password Password to request before reading the tag.
-     * @return return M24SR_SUCCESS if no errors
-     * @note The password must have a length of 16 chars.
+     * Get the capability container cached by the driver, it is read the first time a
+     * session is opened and reused until invalidated or a different tag is detected at reset.
+     * @param cc Where to copy the capability container.
+     * @return true if a capability container is cached, false otherwise
      */
-    M24srError_t enable_read_password(const uint8_t* current_write_password, const uint8_t* new_password) {
-        _subcommand_cb = &_change_password_request_status_cb;
-        _change_password_request_status_cb.set_task(READ_PASSWORD, new_password);
+    bool get_capability_container(CapabilityContainer_t *cc) const {
+        if (!_cc_valid) {
+            return false;
+        }
 
-        return verify(WRITE_PASSWORD, current_write_password);
+        *cc = _cc;
+        return true;
     }
 
     /**
-     * Disable the request of a password before reading the tag.
-     * @param current_write_password Current password
-     * @return return M24SR_SUCCESS if no errors
-     * @note The password must have a length of 16 chars.
+     * @return the 8-bit I2C address of the chip driven by this instance
      */
-    M24srError_t disable_read_password(const uint8_t* current_write_password) {
-        _subcommand_cb = &_change_password_request_status_cb;
-        _change_password_request_status_cb.set_task(READ_PASSWORD, NULL);
-
-        return verify(WRITE_PASSWORD, current_write_password);
+    uint8_t get_address() const {
+        return _address;
     }
 
     /**
-     * Enable the request of a password before writing to the tag.
-     * @param current_write_password Current password
-     * @param new_password Password to request before reading the tag.
-     * @return return M24SR_SUCCESS if no errors
-     * @note The password must have a length of 16 chars.
+     * Get the system file read at reset.
+     * @param system_file Where to copy the system file content.
+     * @return true if the system file could be read, false otherwise
      */
-    M24srError_t enable_write_password(const uint8_t* current_write_password, uint8_t* new_password) {
-        _subcommand_cb = &_change_password_request_status_cb;
-        _change_password_request_status_cb.set_task(WRITE_PASSWORD, new_password);
+    bool get_system_file(SystemFile_t *system_file) const {
+        if (!_system_file_valid) {
+            return false;
+        }
 
-        return verify(WRITE_PASSWORD, current_write_password);
+        *system_file = _system_file;
+        return true;
     }
 
     /**
-     * Disable the request of a password before writing the tag.
-     * @param current_write_password Current password.
-     * @return return M24SR_SUCCESS if no errors
-     * @note The password must have a length of 16 chars.
+     * Drop the cached capability container, the CC file will be read again
+     * by the next session opening. Use it after changing the CC file from the RF side.
      */
-    M24srError_t disable_write_password(const uint8_t* current_write_password) {
-        _subcommand_cb = &_change_password_request_status_cb;
-        _change_password_request_status_cb.set_task(WRITE_PASSWORD, NULL);
+    void invalidate_capability_container() {
+        _cc_valid = false;
+        update_ndef_capacity();
+    }
+
+    /**
+     * Select how the commands complete. In SYNC mode each command waits for the chip,
+     * according to the poll configuration. In ASYNC mode the commands return once sent,
+     * the chip signals its answer on the GPO and the answer is processed from the event
+     * queue, leaving the CPU free while the chip works. An answer whose edge doesn't come
+     * within twice the typical command time is polled for from the event queue.
+     * The chip GPO is set up again as by reset, call it outside a session and not from
+     * a delegate or callback in SYNC mode.
+     * @param mode SYNC or ASYNC, also used by the next resets.
+     * @return M24SR_SUCCESS, M24SR_IO_PIN_NOT_CONNECTED if ASYNC is requested without GPO
+     * pin or event queue, M24SR_ERROR if the driver is in an M24srDriverPool or called
+     * from a SYNC callback, or the error of the chip set up
+     */
+    M24srError_t set_communication_mode(Communication_t mode);
 
-        return verify(WRITE_PASSWORD, current_write_password);
+    /**
+     * @return the mode the commands currently complete in
+     */
+    Communication_t get_communication_mode() const {
+        return _communication_type;
     }
 
     /**
-     * @brief This function disables both read and write passwords.
-     * @param super_user_password I2C super user password.
-     * @return return M24SR_SUCCESS if no errors
-     * @note The password must have a length of 16 chars.
+     * Change how the driver waits for the chip answer in SYNC mode.
+     * POLL_GPO needs the I2C GPO to signal the answers, it is set up by the next reset
+     * if the transport can see the GPO line (M24srTransport::can_wait_gpo_edge).
+     * @param config New strategy, timeout and intervals.
      */
-    M24srError_t disable_all_password(const uint8_t* super_user_password) {
-        _subcommand_cb = &_remove_password_cb;
-        return verify(I2C_PASSWORD, super_user_password);
+    void set_poll_config(const PollConfig_t &config) {
+        _poll_config = config;
     }
 
     /**
-     * @brief This function enables read only mode.
-     * @param current_write_password Write password is needed to enable read only mode.
-     * @return return M24SR_SUCCESS if no errors
-     * @note The password must have a length of 16 chars.
+     * @return counters of the waits since construction or the last reset_poll_statistics
      */
-    M24srError_t enable_read_only(const uint8_t* current_write_password) {
-        _subcommand_cb = &_change_access_state_cb;
-        _change_access_state_cb.change_access_state(ChangeAccessStateCallback::WRITE, false);
+    const PollStatistics_t &poll_statistics() const {
+        return _poll_statistics;
+    }
 
-        return verify(WRITE_PASSWORD, current_write_password);
+    /**
+     * Clear the counters of the waits.
+     */
+    void reset_poll_statistics() {
+        memset(&_poll_statistics, 0, sizeof(_poll_statistics));
     }
 
     /**
-     * @brief This function disables read only mode.
-     * @param current_write_password Write password is needed to disable read only mode.
-     * @return return M24SR_SUCCESS if no errors
-     * @note The password must have a length of 16 chars.
+     * @return counters of the GPO edges since construction or the last reset_gpo_event_statistics
      */
-    M24srError_t disable_read_only(const uint8_t* current_write_password) {
-        _subcommand_cb = &_change_access_state_cb;
-        _change_access_state_cb.change_access_state(ChangeAccessStateCallback::WRITE, true);
+    GpoEventStatistics_t gpo_event_statistics() const {
+        GpoEventStatistics_t statistics;
+        statistics.edges = core_util_atomic_load_u32(&_gpo_event_statistics.edges);
+        statistics.coalesced = core_util_atomic_load_u32(&_gpo_event_statistics.coalesced);
+        statistics.dropped = core_util_atomic_load_u32(&_gpo_event_statistics.dropped);
+        return statistics;
+    }
 
-        return verify(I2C_PASSWORD, current_write_password);
+    /**
+     * Clear the counters of the GPO edges.
+     */
+    void reset_gpo_event_statistics() {
+        core_util_atomic_store_u32(&_gpo_event_statistics.edges, 0);
+        core_util_atomic_store_u32(&_gpo_event_statistics.coalesced, 0);
+        core_util_atomic_store_u32(&_gpo_event_statistics.dropped, 0);
     }
 
+#if MBED_CONF_M24SR_COMMAND_STATISTICS
     /**
-     * @brief This function enables write only mode.
-     * @param current_write_password Write password is needed to enable write only mode.
-     * @return return M24SR_SUCCESS if no errors
-     * @note The password must have a length of 16 chars.
+     * Copy the counters of a command, times are measured with the transport time base.
+     * In ASYNC mode call it from the context processing the driver events.
+     * @param command Command to read the counters of.
+     * @param snapshot Where to copy the counters.
      */
-    M24srError_t enable_write_only(const uint8_t* current_write_password) {
-        _subcommand_cb = &_change_access_state_cb;
-        _change_access_state_cb.change_access_state(ChangeAccessStateCallback::READ, false);
+    void get_command_statistics(Command_t command, CommandStatistics_t *snapshot) const {
+        *snapshot = _command_statistics[command];
+    }
 
-        return verify(WRITE_PASSWORD, current_write_password);
+    /**
+     * Clear the counters of all the commands.
+     */
+    void reset_command_statistics() {
+        memset(_command_statistics, 0, sizeof(_command_statistics));
     }
+#endif
 
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
     /**
-     * @brief This function disables write only mode.
-     * @param current_write_password Write password is needed to disable write only mode.
-     * @return return M24SR_SUCCESS if no errors
-     * @note The password must have a length of 16 chars.
+     * Queue an operation, the requests run one after the other in submission order, each
+     * one is started from the completion of the previous one without going back to the
+     * application. While requests are pending the results are reported to their callback
+     * only, not to the delegate, and the NFCEEPROMDriver methods must not be called.
+     * In SYNC mode the queue is run by this call, which returns once it is empty.
+     * In ASYNC mode call it from the context processing the driver events.
+     * @param request Operation to run.
+     * @param callback Called when the request completes, can be empty.
+     * @return id of the request, NO_REQUEST if the queue is full
      */
-    M24srError_t disable_write_only(const uint8_t* current_write_password) {
-        _subcommand_cb = &_change_access_state_cb;
-        _change_access_state_cb.change_access_state(ChangeAccessStateCallback::READ, true);
+    RequestId_t submit(const Request_t &request, const RequestCallback_t &callback);
+
+    /**
+     * Drop a request that didn't start yet, its callback is not called. A byte request
+     * in progress is stopped after the chunk being transferred and completes with
+     * M24SR_ERROR and the number of bytes already transferred.
+     * @param id Request to cancel.
+     * @return true if the request was dropped or will stop, false if it already completed
+     * or is an operation in progress that can't be stopped
+     */
+    bool cancel(RequestId_t id);
 
-        return verify(I2C_PASSWORD, current_write_password);
+    /**
+     * @return number of requests waiting, the one in progress included
+     */
+    size_t pending_requests() const {
+        return _request_count + (_request_running ? 1 : 0);
     }
+#endif
 
 private:
-    M24srError_t init();
-    M24srError_t read_id(uint8_t *nfc_id);
-    M24srError_t get_session(bool force = false);
-
-    M24srError_t deselect();
+    /**
+     * Object notified of the end of the NFCEEPROMDriver operations, it hides
+     * NFCEEPROMDriver::delegate to take the results of the queued requests.
+     * @return the delegate of the request in progress, or the application one
+     */
+    Delegate *delegate() {
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+        if (_request_running) {
+            return &_request_delegate;
+        }
+#endif
+        return NFCEEPROMDriver::delegate();
+    }
+
+    /**
+     * @return true if the transfer in progress must stop after the current chunk
+     */
+    bool is_transfer_cancelled() const {
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+        return _request_cancelled;
+#else
+        return false;
+#endif
+    }
+
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+    void run_requests();
+    void start_request();
+    void complete_request(M24srError_t status, size_t count);
+    void cancel_requests();
+
+    /**
+     * Complete a byte request.
+     * @param count Number of bytes transferred.
+     */
+    void complete_transfer(size_t count) {
+        complete_request(count == _request.request.count ? M24SR_SUCCESS : M24SR_ERROR, count);
+    }
+
+    /**
+     * Complete a request reported through the delegate.
+     * @param success Result given to the delegate.
+     */
+    void complete_operation(bool success) {
+        complete_request(success ? M24SR_SUCCESS : M24SR_ERROR, 0);
+    }
+#endif
+
+    /**
+     * Notify the delegate of the end of a write or erase.
+     * @param bytes Data written, NULL for an erase.
+     * @param count Number of bytes written.
+     */
+    void report_bytes_written(const uint8_t *bytes, size_t count) {
+        if (bytes) {
+            delegate()->on_bytes_written(count);
+        } else {
+            delegate()->on_bytes_erased(count);
+        }
+    }
+
+    /**
+     * Start measuring a frame.
+     * @param command Command the frame belongs to.
+     * @param length Number of bytes sent.
+     */
+    void record_send(Command_t command, uint8_t length) {
+#if MBED_CONF_M24SR_COMMAND_STATISTICS
+        _sample.command = command;
+        _sample.start_us = _transport->now_us();
+        _sample.ready_us = 0;
+        _command_statistics[command].count++;
+        _command_statistics[command].bytes_sent += length;
+#endif
+    }
+
+    /**
+     * Note the end of the wait for the chip.
+     * @param polls Number of address polls sent.
+     */
+    void record_ready(uint32_t polls) {
+#if MBED_CONF_M24SR_COMMAND_STATISTICS
+        CommandStatistics_t &stats = _command_statistics[_sample.command];
+        _sample.ready_us = _transport->now_us();
+        stats.polls += polls;
+        stats.ready_time_us += _sample.ready_us - _sample.start_us;
+#endif
+    }
+
+    /**
+     * End the measure of a frame.
+     * @param length Number of bytes received.
+     */
+    void record_response(uint8_t length) {
+#if MBED_CONF_M24SR_COMMAND_STATISTICS
+        CommandStatistics_t &stats = _command_statistics[_sample.command];
+        const uint32_t latency = (uint32_t) (_transport->now_us() - _sample.start_us);
+        size_t bin = 0;
+
+        while (bin < LATENCY_HISTOGRAM_BINS - 1 && latency >= ((uint32_t) LATENCY_HISTOGRAM_FIRST_US << bin)) {
+            bin++;
+        }
+
+        stats.bytes_received += length;
+        stats.total_time_us += latency;
+        stats.latency_histogram[bin]++;
+        if (latency > stats.max_latency_us) {
+            stats.max_latency_us = latency;
+        }
+#endif
+    }
+
+    /**
+     * Count the frame being measured as failed.
+     */
+    void record_failure() {
+#if MBED_CONF_M24SR_COMMAND_STATISTICS
+        _command_statistics[_sample.command].failures++;
+#endif
+    }
+
+    /* runs in the interrupt: no allocation, only atomic accesses to what the event queue reads */
+    void nfc_interrupt_callback() {
+        if (_last_command == NONE && (_rf_gpo_config == SESSION_OPENED || _rf_gpo_config == WIP)) {
+            /* no answer is expected, the edge comes from the RF side */
+            core_util_atomic_store_bool(&_rf_activity, true);
+        }
+
+        if (_communication_type != ASYNC || _pooled) {
+            return;
+        }
+
+        core_util_atomic_incr_u32(&_gpo_event_statistics.edges, 1);
+
+        /* a single event waits in the queue at a time, it handles all the edges seen before it runs */
+        if (core_util_atomic_exchange_bool(&_gpo_event_pending, true)) {
+            core_util_atomic_incr_u32(&_gpo_event_statistics.coalesced, 1);
+            return;
+        }
+
+        /* the event is part of the driver, posting it takes no memory from the queue */
+        if (!_gpo_event.try_call_on(event_queue())) {
+            /* still running the previous edge, it takes this one before it returns */
+            core_util_atomic_store_bool(&_gpo_event_pending, false);
+            core_util_atomic_store_bool(&_gpo_edge_missed, true);
+            core_util_atomic_incr_u32(&_gpo_event_statistics.dropped, 1);
+        }
+    }
+
+    void process_gpo_edge();
+    void take_gpo_edge();
+    void check_answer();
+    void arm_answer_check(uint32_t delay_us);
+
+    /**
+     * @return true if ASYNC mode can be used
+     */
+    bool is_async_possible() {
+        return _gpo_pin.is_connected() != 0 && event_queue() != NULL;
+    }
+
+    /**
+     * @return true if the SYNC waits can use the GPO edges, without it POLL_GPO polls at a fixed interval
+     */
+    bool is_gpo_poll_possible() {
+        return _poll_config.strategy == POLL_GPO && _transport->can_wait_gpo_edge();
+    }
+
+    /**
+     * Enable the request of a password before reading the tag.
+     * @param current_write_password Current password
+     * @param new_password Password to request before reading the tag.
+     * @return return M24SR_SUCCESS if no errors
+     * @note The password must have a length of 16 chars.
+     */
+    M24srError_t enable_read_password(const uint8_t* current_write_password, const uint8_t* new_password) {
+        return start_password_operation(OPERATION_ENABLE_READ_PASSWORD, current_write_password, new_password);
+    }
+
+    /**
+     * Disable the request of a password before reading the tag.
+     * @param current_write_password Current password
+     * @return return M24SR_SUCCESS if no errors
+     * @note The password must have a length of 16 chars.
+     */
+    M24srError_t disable_read_password(const uint8_t* current_write_password) {
+        return start_password_operation(OPERATION_DISABLE_READ_PASSWORD, current_write_password, NULL);
+    }
+
+    /**
+     * Enable the request of a password before writing to the tag.
+     * @param current_write_password Current password
+     * @param new_password Password to request before reading the tag.
+     * @return return M24SR_SUCCESS if no errors
+     * @note The password must have a length of 16 chars.
+     */
+    M24srError_t enable_write_password(const uint8_t* current_write_password, uint8_t* new_password) {
+        return start_password_operation(OPERATION_ENABLE_WRITE_PASSWORD, current_write_password, new_password);
+    }
+
+    /**
+     * Disable the request of a password before writing the tag.
+     * @param current_write_password Current password.
+     * @return return M24SR_SUCCESS if no errors
+     * @note The password must have a length of 16 chars.
+     */
+    M24srError_t disable_write_password(const uint8_t* current_write_password) {
+        return start_password_operation(OPERATION_DISABLE_WRITE_PASSWORD, current_write_password, NULL);
+    }
+
+    /**
+     * @brief This function disables both read and write passwords.
+     * @param super_user_password I2C super user password.
+     * @return return M24SR_SUCCESS if no errors
+     * @note The password must have a length of 16 chars.
+     */
+    M24srError_t disable_all_password(const uint8_t* super_user_password) {
+        /* it becomes the read and write password */
+        return start_password_operation(OPERATION_DISABLE_ALL_PASSWORD, super_user_password, super_user_password);
+    }
+
+    /**
+     * @brief This function enables read only mode.
+     * @param current_write_password Write password is needed to enable read only mode.
+     * @return return M24SR_SUCCESS if no errors
+     * @note The password must have a length of 16 chars.
+     */
+    M24srError_t enable_read_only(const uint8_t* current_write_password) {
+        return start_password_operation(OPERATION_ENABLE_READ_ONLY, current_write_password, NULL);
+    }
+
+    /**
+     * @brief This function disables read only mode.
+     * @param current_write_password Write password is needed to disable read only mode.
+     * @return return M24SR_SUCCESS if no errors
+     * @note The password must have a length of 16 chars.
+     */
+    M24srError_t disable_read_only(const uint8_t* current_write_password) {
+        return start_password_operation(OPERATION_DISABLE_READ_ONLY, current_write_password, NULL);
+    }
+
+    /**
+     * @brief This function enables write only mode.
+     * @param current_write_password Write password is needed to enable write only mode.
+     * @return return M24SR_SUCCESS if no errors
+     * @note The password must have a length of 16 chars.
+     */
+    M24srError_t enable_write_only(const uint8_t* current_write_password) {
+        return start_password_operation(OPERATION_ENABLE_WRITE_ONLY, current_write_password, NULL);
+    }
+
+    /**
+     * @brief This function disables write only mode.
+     * @param current_write_password Write password is needed to disable write only mode.
+     * @return return M24SR_SUCCESS if no errors
+     * @note The password must have a length of 16 chars.
+     */
+    M24srError_t disable_write_only(const uint8_t* current_write_password) {
+        return start_password_operation(OPERATION_DISABLE_WRITE_ONLY, current_write_password, NULL);
+    }
+
+private:
+    /** completes the commands of the drivers it schedules */
+    friend class M24srDriverPool;
+
+    M24srDriver(M24srTransport *transport, PinName i2c_data_pin, PinName i2c_clock_pin,
+                PinName gpo_pin, PinName rf_disable_pin, uint8_t address);
+
+    M24srError_t init();
+    void parse_capability_container(const uint8_t *cc_file);
+
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+    void shadow_write(uint16_t offset, const uint8_t *bytes, size_t count);
+    void shadow_write_through(uint16_t offset, const uint8_t *bytes, size_t count);
+    void shadow_read(uint16_t offset, uint8_t *bytes, size_t count);
+    void shadow_mark_valid(uint16_t offset, size_t count, bool valid);
+    bool is_shadow_valid(uint16_t offset, size_t count) const;
+    bool is_shadow_dirty(uint16_t offset) const;
+    void shadow_mark_dirty(uint16_t offset, bool dirty);
+    bool next_dirty_range(uint16_t *offset, uint16_t *length) const;
+#endif
+
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
+    bool is_block_unchanged(uint16_t offset, const uint8_t *bytes) const;
+    size_t unchanged_length(uint16_t offset, const uint8_t *bytes, size_t count) const;
+    size_t changed_length(uint16_t offset, const uint8_t *bytes, size_t count) const;
+    void update_block_hashes(uint16_t offset, const uint8_t *bytes, size_t count, bool known);
+#endif
+    void update_ndef_capacity();
+    M24srError_t read_system_file();
+    void decode_system_file();
+    M24srError_t read_id(uint8_t *nfc_id);
+    M24srError_t get_session(bool force = false);
+
+    M24srError_t deselect();
     M24srError_t receive_deselect();
 
     M24srError_t select_application();
@@ -752,6 +1252,7 @@ private:
     M24srError_t receive_read_binary();
 
     M24srError_t update_binary(uint16_t offset, uint8_t length, const uint8_t *data);
+    void prepare_update_binary(uint16_t offset, uint8_t length, const uint8_t *data);
     M24srError_t receive_update_binary();
 
     M24srError_t verify(PasswordType_t password_type, const uint8_t *password);
@@ -784,682 +1285,401 @@ private:
     M24srError_t send_receive_i2c(uint16_t length, uint8_t *command);
 
     /**
-     * Function to call when the component fire an interrupt.
-     * @return last operation status
+     * Forget which application and file are selected, the next SELECT commands will be sent.
      */
-    M24srError_t manage_event();
+    void reset_selection() {
+        _application_selected = false;
+        _selected_file = NO_FILE_SELECTED;
+    }
 
     /**
-     * Send a command to the component.
-     * @param length Length of the command.
-     * @param command Buffer containing the command.
-     * @return M24SR_SUCCESS if no errors
+     * Called when the RF side took over the chip, what the driver knows of the content may be stale.
      */
-    M24srError_t io_send_i2c_command(uint8_t length, const uint8_t *command);
+    void on_rf_activity() {
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+        invalidate_shadow();
+        _ndef_size_valid = false;
+#endif
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
+        invalidate_block_hashes();
+#endif
+    }
 
     /**
-     * Read a command response.
-     * @param length Number of bytes to read.
-     * @param command Buffer to store the response into.
-     * @return M24SR_SUCCESS if no errors
+     * Forget what is known of the content if the GPO reported RF activity since the last call.
      */
-    M24srError_t io_receive_i2c_response(uint8_t length, uint8_t *command);
+    void check_rf_activity() {
+        if (core_util_atomic_exchange_bool(&_rf_activity, false)) {
+            on_rf_activity();
+        }
+    }
 
-    /**
-     * Do an active polling on the I2C bus until the answer is ready.
-     * @return M24SR_SUCCESS if no errors
-     */
-    M24srError_t io_poll_i2c();
+    template<uint16_t command_mask>
+    void build_command(C_APDU *command, uint16_t *length);
 
-    bool manage_sync_communication(M24srError_t *status);
+    uint8_t next_block_number();
 
-private:
     /**
-     * @brief This class permits to enable/disable the password request to read/write into the tag
+     * Function to call when the component fire an interrupt.
+     * @return last operation status
      */
-    class ChangePasswordRequestStatusCallback : public Callbacks {
-    public:
-        /**
-         * Build the chain of callbacks.
-         */
-        ChangePasswordRequestStatusCallback()
-            : _new_password(NULL),
-              _type(I2C_PASSWORD),
-              _enable(false) { }
-
-        /* This class is equivalent to calling the methods:
-         *
-         * To enable the request:
-         * - Verify
-         * - change_reference_data
-         * - enable_permanent_state
-         *
-         * To disable the request:
-         * - verify
-         * - disable_verification_requirement
-         */
-
-        /**
-         * Set the password to enable/disable.
-         * @param type Type of password to enable/disable.
-         * @param new_password Array of 16bytes with the new password, if null the request will be disabled.
-         */
-        void set_task(PasswordType_t type, const uint8_t *new_password) {
-            _new_password = new_password;
-            _type = type;
-            _enable = (new_password != NULL);
-        }
-
-        virtual void on_verified(M24srDriver *nfc, M24srError_t status, PasswordType_t, const uint8_t *) {
-            if (status != M24SR_SUCCESS) {
-                return on_finish_command(nfc, status);
-            }
-            if (_enable) {
-                nfc->change_reference_data(_type, _new_password);
-            } else {
-                nfc->disable_verification_requirement(_type);
-            }
-        }
-
-        virtual void on_disable_verification_requirement(M24srDriver *nfc, M24srError_t status, PasswordType_t) {
-            on_finish_command(nfc, status);
-        }
-
-        virtual void on_change_reference_data(M24srDriver *nfc, M24srError_t status, PasswordType_t type, const uint8_t *) {
-            if (status == M24SR_SUCCESS) {
-                nfc->enable_permanent_state(type);
-            } else {
-                on_finish_command(nfc, status);
-            }
-        }
-
-        virtual void on_enable_permanent_state(M24srDriver *nfc, M24srError_t status, PasswordType_t) {
-            on_finish_command(nfc, status);
-        }
-
-    private:
-        /**
-         * Remove the private callbacks and call the user callback.
-         * @param nfc Object triggering the command.
-         * @param status Command status.
-         */
-        void on_finish_command(M24srDriver *nfc, M24srError_t status) {
-            nfc->_subcommand_cb = NULL;
-
-            if (_enable) {
-                if (_type == READ_PASSWORD) {
-                    nfc->get_callback()->on_enable_read_password(nfc, status, _new_password);
-                } else {
-                    nfc->get_callback()->on_enable_write_password(nfc, status, _new_password);
-                }
-            } else {
-                if (_type == READ_PASSWORD) {
-                    nfc->get_callback()->on_disable_read_password(nfc, status);
-                } else {
-                    nfc->get_callback()->on_disable_write_password(nfc, status);
-                }
-            }
-        }
-
-    private:
-        const uint8_t *_new_password;
-        PasswordType_t _type;
-        bool _enable;
-    };
+    M24srError_t manage_event();
 
     /**
-     * @brief This class permits to disable all the password requests to read/write into the tag.
+     * Complete the command in progress with an error, without reading its answer.
+     * @param status Error to report to the operation in progress.
+     * @return status
      */
-    class RemoveAllPasswordCallback : public Callbacks {
-    public:
-        /**
-         * Build the chain of callbacks.
-         */
-        RemoveAllPasswordCallback()
-            : _password(NULL) { }
-
-        /* This class is equivalent to calling the methods:
-         * - verify(i2c)
-         * - disable_permanent_state(Read)
-         * - disable_permanent_state(write)
-         * - disable_verification_requirement(Read)
-         * - disable_verification_requirement(write)
-         * - change_reference_data(Read)
-         * - change_reference_data(write)
-         */
-
-        virtual void on_verified(M24srDriver *nfc, M24srError_t status, PasswordType_t, const uint8_t* data) {
-            if (status != M24SR_SUCCESS) {
-                return on_finish_command(nfc, status);
-            }
-            _password = data;
-            nfc->disable_permanent_state(READ_PASSWORD);
-        }
-
-        virtual void on_disable_permanent_state(M24srDriver *nfc, M24srError_t status, PasswordType_t type) {
-            if (status != M24SR_SUCCESS) {
-                return on_finish_command(nfc, status);
-            }
-            if (type == READ_PASSWORD) {
-                nfc->disable_permanent_state(WRITE_PASSWORD);
-            } else {
-                nfc->disable_verification_requirement(READ_PASSWORD);
-            }
-        }
-
-        virtual void on_disable_verification_requirement(M24srDriver *nfc, M24srError_t status, PasswordType_t type) {
-            if (status != M24SR_SUCCESS) {
-                return on_finish_command(nfc, status);
-            }
-            if (type == READ_PASSWORD) {
-                nfc->disable_verification_requirement(WRITE_PASSWORD);
-            } else {
-                nfc->change_reference_data(READ_PASSWORD, _password);
-            }
-        }
-
-        virtual void on_change_reference_data(M24srDriver *nfc, M24srError_t status, PasswordType_t type,
-                                              const uint8_t *data) {
-            if (status != M24SR_SUCCESS) {
-                return on_finish_command(nfc, status);
-            }
-            if (type == READ_PASSWORD) {
-                nfc->change_reference_data(WRITE_PASSWORD, data);
-            } else {
-                on_finish_command(nfc, status);
-            }
-        }
-
-    private:
-        /**
-         * Remove the private callback and call the onDisableAllPassword callback.
-         * @param nfc Object triggering the command.
-         * @param status Command status.
-         */
-        void on_finish_command(M24srDriver *nfc, M24srError_t status) {
-            nfc->_subcommand_cb = NULL;
-            _password = NULL;
-            nfc->get_callback()->on_disable_all_password(nfc, status);
-        }
-
-    private:
-        /**
-         * Store the default password used for open a super user session
-         * it will be set as default read/write password
-         */
-        const uint8_t *_password;
-    };
+    M24srError_t manage_error(M24srError_t status);
 
     /**
-     * @brief This class permits to set the tag as read/write only.
+     * Start an operation, its state is set by the caller.
+     * @param operation Operation to run.
+     * @return status of the first command sent, M24SR_SUCCESS if none was
      */
-    class ChangeAccessStateCallback : public Callbacks {
-    public:
-        enum AccessType_t {
-            WRITE,
-            READ
-        };
-
-        /**
-         * Build the chain of callbacks.
-         */
-        ChangeAccessStateCallback()
-            : _type(WRITE),
-              _enable(false) { }
-
-        /* This class is equivalent to calling the methods:
-         * - verify(i2c)
-         * - enable_permanent_state(Read/write)
-         * or:
-         * - verify(i2c)
-         * - disable_permanent_state</li>
-         * - disable_verification_requirement(Read/write)
-         */
-
-        /**
-         * Set the access to enable/disable an access type.
-         * @param type Access type.
-         * @param enable True to enable the state, False to disable it.
-         */
-        void change_access_state(AccessType_t type, bool enable) {
-            _type = type;
-            _enable = enable;
-        }
+    M24srError_t start_operation(Operation_t operation);
 
-        virtual void on_verified(M24srDriver *nfc, M24srError_t status, PasswordType_t, const uint8_t*) {
-            if (status != M24SR_SUCCESS) {
-                return on_finish_command(nfc, status);
-            }
-
-            if (_enable) {
-                nfc->disable_permanent_state(_type == WRITE ? WRITE_PASSWORD : READ_PASSWORD);
-            } else {
-                nfc->enable_permanent_state(_type == WRITE ? WRITE_PASSWORD : READ_PASSWORD);
-            }
-
-        }
+    /**
+     * Start a password or access change.
+     * @param operation Operation to run.
+     * @param password Password checked first.
+     * @param new_password Password set by the operation, NULL if none.
+     * @return status of the first command sent
+     */
+    M24srError_t start_password_operation(Operation_t operation, const uint8_t *password, const uint8_t *new_password);
 
-        virtual void on_disable_permanent_state(M24srDriver *nfc, M24srError_t status, PasswordType_t type) {
-            if (status != M24SR_SUCCESS) {
-                return on_finish_command(nfc, status);
-            }
+    /**
+     * Send the command of the step in progress, or of the next one not skipped.
+     * @return status of the command sent, M24SR_SUCCESS if the operation ended without sending one
+     */
+    M24srError_t run_step();
 
-            nfc->disable_verification_requirement(type);
-        }
+    /**
+     * Check whether the step has a command to send.
+     * @param step Step about to run.
+     * @return false if the step is skipped
+     */
+    bool prepare_step(const Step_t &step);
 
-        virtual void on_disable_verification_requirement(M24srDriver *nfc, M24srError_t status, PasswordType_t) {
-            on_finish_command(nfc, status);
-        }
+    /**
+     * Send the command of a step.
+     * @param step Step to run.
+     * @return status of the command
+     */
+    M24srError_t send_step(const Step_t &step);
 
-        virtual void on_enable_permanent_state(M24srDriver *nfc, M24srError_t status, PasswordType_t) {
-            on_finish_command(nfc, status);
-        }
+    /**
+     * Take the answer of a step that succeeded.
+     * @param step Step that got its answer.
+     * @return true if the step sends its command again, e.g. for the next chunk
+     */
+    bool complete_step(const Step_t &step);
 
-    private:
-        /**
-         * Remove the private callback and call the user callback.
-         * @param nfc Object triggering the command.
-         * @param status Command status.
-         */
-        void on_finish_command(M24srDriver *nfc, M24srError_t status) {
-            nfc->_subcommand_cb = NULL;
-            if (_enable) {
-                if (_type == READ) {
-                    //enable read = disable write only
-                    nfc->get_callback()->on_disable_write_only(nfc, status);
-                } else {
-                    //enable write = disable read only
-                    nfc->get_callback()->on_disable_read_only(nfc, status);
-                }
-            } else {
-                if (_type == WRITE) {
-                    //disable write = enable read only
-                    nfc->get_callback()->on_enable_read_only(nfc, status);
-                } else {
-                    nfc->get_callback()->on_enable_write_only(nfc, status);
-                }
-            }
-        }
+    /**
+     * Called with the answer of each command: runs the next step of the operation in progress.
+     * @param status Status of the answer.
+     */
+    void step_done(M24srError_t status);
 
-    private:
-        AccessType_t _type;
-        bool _enable;
-    };
+    /**
+     * Called once an update binary frame is sent, while the chip is programming.
+     */
+    void step_sent();
 
     /**
-     * @brief Object with the callback used to send a ManageGPO command.
+     * Report the end of the operation in progress.
+     * @param status M24SR_SUCCESS, or the error of the step in progress.
      */
-    class ManageGPOCallback : public Callbacks {
+    void finish_operation(M24srError_t status);
 
-    public:
-        /**
-         * Build the chain of callbacks.
-         * @param parent Parent component to run the command on.
-         */
-        ManageGPOCallback()
-            : _new_gpo_config(HIGH_IMPEDANCE),
-              _read_gpo_config(0),
-              _change_i2c_gpo(true) { }
-
-        /* This class is equivalent to calling the methods:
-         * - selected_application
-         * - select_system_file
-         * - read_binary
-         * - verify
-         * - update_binary
-         */
-
-        /**
-         * Command parameters.
-         * @param i2cGpo true to change the i2c gpo, false for the rf gpo.
-         * @param new_config new gpo function.
-         */
-        void set_new_gpo_config(bool i2cGpo, NfcGpoState_t new_config) {
-            _new_gpo_config = new_config;
-            _change_i2c_gpo = i2cGpo;
-        }
+    /**
+     * @return number of bytes of the write chunk starting done bytes into the range
+     */
+    uint8_t write_chunk_length(size_t done);
 
-        virtual void on_selected_application(M24srDriver *nfc, M24srError_t status) {
-            if (status == M24SR_SUCCESS) {
-                nfc->select_system_file();
-            } else {
-                on_finish_command(nfc, status);
-            }
-        }
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
+    /**
+     * @return done, moved past the blocks that already hold the data
+     */
+    size_t write_chunk_start(size_t done);
+#endif
 
-        virtual void on_selected_system_file(M24srDriver *nfc, M24srError_t status) {
-            if (status == M24SR_SUCCESS) {
-                nfc->read_binary(0x0004, 0x01, &_read_gpo_config);
-            } else {
-                on_finish_command(nfc, status);
-            }
-        }
+    /**
+     * @return data of the write chunk starting done bytes into the range, NULL to erase
+     */
+    const uint8_t *write_chunk_data(size_t done) const {
+        return _operation_state.write.bytes ? _operation_state.write.bytes + done : NULL;
+    }
 
-        virtual void on_read_byte(M24srDriver *nfc, M24srError_t status, uint16_t, uint8_t*, uint16_t) {
-            if (status == M24SR_SUCCESS) {
-                nfc->verify(I2C_PASSWORD, default_password);
-            } else {
-                on_finish_command(nfc, status);
-            }
-        }
+    /**
+     * Check the CRC and status of a response.
+     * @param data Response.
+     * @param length Number of bytes in the response.
+     * @return M24SR_SUCCESS if the command succeeded, the error otherwise
+     */
+    M24srError_t check_response(uint8_t *data, uint8_t length);
 
-        virtual void on_verified(M24srDriver *nfc, M24srError_t status, PasswordType_t, const uint8_t*) {
-            if (status != M24SR_SUCCESS) {
-                return on_finish_command(nfc, status);
-            }
+    /**
+     * Check the CRC and status of a response received in several buffers.
+     * @param fragments Parts of the response, in order.
+     * @param count Number of fragments.
+     * @return M24SR_SUCCESS if the command succeeded, the error otherwise
+     */
+    M24srError_t check_response(const M24srFragment_t *fragments, size_t count);
 
-            if (_change_i2c_gpo) {
-                _read_gpo_config = (_read_gpo_config & 0xF0) | (uint8_t) _new_gpo_config;
-            } else {
-                _read_gpo_config = (_read_gpo_config & 0x0F) | (((uint8_t) _new_gpo_config) << 4);
-            }
+    /**
+     * Update the driver state after a response.
+     * @param status Status of the response.
+     * @return status
+     */
+    M24srError_t check_status(M24srError_t status);
 
-            nfc->update_binary(0x0004, 0x01, &_read_gpo_config);
-        }
+    /**
+     * Send a command to the component.
+     * @param command_type Command being sent.
+     * @param length Length of the command.
+     * @param command Buffer containing the command.
+     * @return M24SR_SUCCESS if no errors
+     */
+    M24srError_t io_send_i2c_command(Command_t command_type, uint8_t length, const uint8_t *command);
 
-        virtual void on_updated_binary(M24srDriver *nfc, M24srError_t status, uint16_t, uint8_t*, uint16_t) {
+    /**
+     * Send a command made of several buffers in a single transaction.
+     * @param command_type Command being sent.
+     * @param fragments Parts of the command, in order.
+     * @param count Number of fragments.
+     * @return M24SR_SUCCESS if no errors
+     */
+    M24srError_t io_send_i2c_command(Command_t command_type, const M24srConstFragment_t *fragments, size_t count);
 
-            if (status == M24SR_SUCCESS) {
-                if (_new_gpo_config == I2C_ANSWER_READY) {
-                    nfc->_communication_type = ASYNC;
-                } else {
-                    nfc->_communication_type = SYNC;
-                }
-            }
-            on_finish_command(nfc, status);
-        }
+    /**
+     * Read a command response.
+     * @param length Number of bytes to read.
+     * @param command Buffer to store the response into.
+     * @return M24SR_SUCCESS if no errors
+     */
+    M24srError_t io_receive_i2c_response(uint8_t length, uint8_t *command);
 
-    private:
-        /**
-         * Remove the private callback and call the user callback.
-         * @param nfc Object where the command was send to.
-         * @param status Command status.
-         */
-        void on_finish_command(M24srDriver *nfc, M24srError_t status) {
-            nfc->_subcommand_cb = NULL;
-            if (_change_i2c_gpo) {
-                nfc->_command_cb->on_manage_i2c_gpo(nfc, status, _new_gpo_config);
-            } else {
-                nfc->_command_cb->on_manage_rf_gpo(nfc, status, _new_gpo_config);
-            }
-        }
+    /**
+     * Read a command response into several buffers in a single transaction.
+     * @param fragments Buffers to fill, in order.
+     * @param count Number of fragments.
+     * @return M24SR_SUCCESS if no errors
+     */
+    M24srError_t io_receive_i2c_response(const M24srFragment_t *fragments, size_t count);
 
-    private:
-        /** new gpo function that this class has to write */
-        NfcGpoState_t _new_gpo_config;
+    /**
+     * Wait until the answer is ready, according to the poll configuration.
+     * @param command Command being waited for.
+     * @return M24SR_SUCCESS if no errors, M24SR_IO_ERROR_I2CTIMEOUT if the chip didn't answer in time
+     */
+    M24srError_t io_poll_i2c(Command_t command);
 
-        /** variable where storeing the read gpo configuration */
-        uint8_t _read_gpo_config;
+    /**
+     * @return typical time in microseconds the chip needs to answer the command in progress
+     */
+    uint32_t expected_answer_time() const;
 
-        /** true to change the i2c gpo, false to change the rf gpo */
-        bool _change_i2c_gpo;
-    };
+    bool manage_sync_communication(M24srError_t *status);
 
+private:
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
     /**
-     * @brief Object with the callback used to read the component ID
+     * Delegate used while a request runs, it completes the NFCEEPROMDriver operations
      */
-    class ReadIDCallback : public Callbacks {
+    class RequestDelegate : public NFCEEPROMDriver::Delegate {
     public:
-        /**
-         * Build the chain of callbacks.
-         * @param parent object where to send the command to.
-         */
-        ReadIDCallback() : _id(NULL) { }
-
-        /* This class is equivalent to calling the methods:
-         * - select_application
-         * - select_system_file
-         * - read_binary
-         */
-
-        /**
-         * Set the variable containing the result
-         * @param idPtr
-         */
-        void set_task(uint8_t *id) {
-            _id = id;
-        }
-
-        virtual void on_selected_application(M24srDriver *nfc, M24srError_t status) {
-            if (status == M24SR_SUCCESS) {
-                nfc->select_system_file();
-            } else {
-                on_finish_command(nfc, status);
-            }
+        RequestDelegate(M24srDriver *nfc) : _nfc(nfc) { }
 
+        virtual void on_session_started(bool success) {
+            _nfc->complete_operation(success);
         }
 
-        virtual void on_selected_system_file(M24srDriver *nfc, M24srError_t status) {
-            if (status == M24SR_SUCCESS) {
-                nfc->read_binary(0x0011, 0x01, _id);
-            } else {
-                on_finish_command(nfc, status);
-            }
+        virtual void on_session_ended(bool success) {
+            _nfc->complete_operation(success);
         }
 
-        virtual void on_read_byte(M24srDriver *nfc, M24srError_t status, uint16_t, uint8_t *, uint16_t) {
-            on_finish_command(nfc, status);
+        virtual void on_bytes_read(size_t count) {
+            _nfc->complete_transfer(count);
         }
 
-    private:
-        /**
-         * Remove the private callback and call the user onReadId function.
-         * @param nfc Object where the command was send.
-         * @param status Command status.
-         */
-        void on_finish_command(M24srDriver *nfc, M24srError_t status) {
-            nfc->_subcommand_cb = NULL;
-            nfc->get_callback()->on_read_id(nfc, status, _id);
+        virtual void on_bytes_written(size_t count) {
+            _nfc->complete_transfer(count);
         }
 
-    private:
-        /** pointer to read id */
-        uint8_t *_id;
-    };
-
-    /**
-     * Class containing the callback needed to open a session and read the max
-     * read/write size
-     */
-    class OpenSessionCallBack : public Callbacks {
-    public:
-        OpenSessionCallBack()
-            : _retries(OPEN_SESSION_RETRIES) { }
-
-        void on_session_open(M24srDriver *nfc, M24srError_t status) {
-            if (status == M24SR_SUCCESS) {
-                nfc->select_application();
-            } else {
-                nfc->delegate()->on_session_started(false);
-            }
-        }
-
-        void on_selected_application(M24srDriver *nfc, M24srError_t status) {
-            if (status == M24SR_SUCCESS) {
-                nfc->select_cc_file();
-            } else {
-                if (_retries == 0) {
-                    nfc->delegate()->on_session_started(false);
-                } else {
-                    _retries--;
-                    nfc->select_application();
-                }
-            }
+        virtual void on_size_written(bool success) {
+            _nfc->complete_operation(success);
         }
 
-        void on_selected_cc_file(M24srDriver *nfc, M24srError_t status) {
-            if (status == M24SR_SUCCESS) {
-                nfc->read_binary(0x0000, CC_FILE_LENGTH, CCFile);
-            } else {
-                nfc->delegate()->on_session_started(false);
-            }
+        virtual void on_size_read(bool success, size_t size) {
+            _nfc->complete_request(success ? M24SR_SUCCESS : M24SR_ERROR, size);
         }
 
-        void on_read_byte(M24srDriver *nfc, M24srError_t status, uint16_t, uint8_t *bytes_read,
-                          uint16_t read_count) {
-            if (status != M24SR_SUCCESS || read_count != CC_FILE_LENGTH) {
-                nfc->delegate()->on_session_started(false);
-            }
-            uint16_t ndef_file_id = (uint16_t) ((bytes_read[0x09] << 8) | bytes_read[0x0A]);
-            nfc->_max_read_bytes = (uint16_t) ((bytes_read[0x03] << 8) | bytes_read[0x04]);
-            nfc->_max_write_bytes = (uint16_t) ((bytes_read[0x05] << 8) | bytes_read[0x06]);
-            nfc->select_ndef_file(ndef_file_id);
-        }
-
-        void on_selected_ndef_file(M24srDriver *nfc, M24srError_t status) {
-            nfc->_is_session_open = (status == M24SR_SUCCESS);
-            nfc->delegate()->on_session_started(nfc->_is_session_open);
+        virtual void on_bytes_erased(size_t count) {
+            _nfc->complete_transfer(count);
         }
 
     private:
-        /** number of trials done for open the session */
-        uint32_t _retries;
-
-        /** buffer where read the CC file */
-        uint8_t CCFile[15];
+        M24srDriver *_nfc;
     };
+#endif
 
-    /**
-     * Class containing the callback needed to close a session
-     */
-    class CloseSessionCallBack : public Callbacks {
-    public:
-        CloseSessionCallBack() { }
-
-        virtual void on_deselect(M24srDriver *nfc, M24srError_t status) {
-            if (status == M24SR_SUCCESS) {
-                nfc->_is_session_open = false;
-                nfc->delegate()->on_session_ended(true);
-            } else {
-                nfc->delegate()->on_session_ended(false);
-            }
-        }
-    };
+private:
+    /** Default password used to change the write/read permission */
+    static const uint8_t default_password[16];
 
-    /**
-     * Class containing the callback needed to write a buffer
-     */
-    class WriteByteCallback : public Callbacks {
-    public:
-        WriteByteCallback() { }
+    /** link to the chip */
+    M24srTransport *_transport;
 
-        virtual void on_updated_binary(M24srDriver *nfc, M24srError_t status, uint16_t offset, uint8_t *bytes_written,
-                                       uint16_t write_count) {
-            if (status != M24SR_SUCCESS) {
-                nfc->delegate()->on_bytes_written(0);
-                return;
-            }
+    /** storage for the default I2C transport, used when none is provided */
+    alignas(M24srI2CTransport) uint8_t _i2c_transport_storage[sizeof(M24srI2CTransport)];
 
-            nfc->delegate()->on_bytes_written(write_count);
-        }
-    };
+    /** storage for the GPO interrupt, only built with a GPO pin: some targets assert on NC */
+    alignas(InterruptIn) uint8_t _gpo_event_interrupt_storage[sizeof(InterruptIn)];
 
-    /**
-     * Class containing the callback needed to read a buffer
-     */
-    class ReadByteCallback : public Callbacks {
-    public:
-        ReadByteCallback() { }
+    /** Interrupt object fired when the gpo status changes, NULL without GPO pin */
+    InterruptIn *_gpo_event_interrupt;
+    DigitalIn _gpo_pin;
+    DigitalOut _rf_disable_pin;
 
-        virtual void on_read_byte(M24srDriver *nfc, M24srError_t status, uint16_t offset, uint8_t *bytes_read,
-                                  uint16_t read_count) {
-            if (status != M24SR_SUCCESS) {
-                nfc->delegate()->on_bytes_read(0);
-                return;
-            }
+    /** operation run by the step engine, OPERATION_NONE if none */
+    Operation_t _operation;
+    /** index in the table of _operation of the step in progress */
+    uint8_t _step;
+    /** number of times the command of the step can still be sent again after a failure */
+    uint8_t _step_retries;
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+    /** the operation in progress was started by the request in progress and completes it */
+    bool _operation_request;
+#endif
 
-            nfc->delegate()->on_bytes_read(read_count);
-        }
+    /**
+     * State of the operation in progress, only the member of _operation is valid. The
+     * operations writing the shadow keep no other state: the flush has the slot for itself.
+     */
+    union {
+        struct {
+            bool force;
+            uint8_t cc_file[CC_FILE_LENGTH];
+        } session; /**< OPERATION_START_SESSION */
+        struct {
+            uint16_t offset;
+            uint8_t *bytes;
+            size_t count;
+            size_t done;
+        } read; /**< OPERATION_READ_BYTES, offset in the NDEF file */
+        struct {
+            uint16_t offset;
+            const uint8_t *bytes; /**< NULL to erase */
+            size_t count;
+            size_t done;
+        } write; /**< OPERATION_WRITE_BYTES, offset in the NDEF file */
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+        struct {
+            uint16_t offset;
+            uint16_t length;
+        } flush; /**< range of the shadow written by STEP_FLUSH_SHADOW */
+#endif
+        struct {
+            NfcGpoState_t config;
+            uint8_t value; /**< GPO byte of the system file, sent by the update */
+        } gpo; /**< OPERATION_I2C_GPO and OPERATION_RF_GPO */
+        uint8_t *id; /**< OPERATION_READ_ID */
+        struct {
+            const uint8_t *password;
+            const uint8_t *new_password;
+        } password; /**< password and access changes */
+    } _operation_state;
+
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+    /** request and the function to call when it completes */
+    struct QueuedRequest_t {
+        RequestId_t id;
+        Request_t request;
+        RequestCallback_t callback;
     };
 
-    class SetSizeCallback : public Callbacks {
-    public:
-        SetSizeCallback() { }
+    /** requests waiting for their turn, the oldest at _request_head */
+    QueuedRequest_t _requests[MBED_CONF_M24SR_REQUEST_QUEUE_SIZE];
+    size_t _request_head;
+    size_t _request_count;
+
+    /** request in progress, valid while _request_running is set */
+    QueuedRequest_t _request;
+    bool _request_running;
+    /** the byte request in progress stops after the current chunk */
+    bool _request_cancelled;
+    /** run_requests is starting the requests, the calls from their callbacks return at once */
+    bool _requests_dispatching;
+
+    RequestId_t _last_request_id;
+    RequestDelegate _request_delegate;
+#endif
 
-        virtual void on_updated_binary(M24srDriver *nfc, M24srError_t status, uint16_t offset, uint8_t *bytes_written,
-                                       uint16_t write_count) {
-            if (status != M24SR_SUCCESS) {
-                nfc->delegate()->on_size_written(false);
-                return;
-            }
+    /** called after each chunk of a multi-chunk transfer */
+    mbed::Callback<void(size_t, size_t)> _progress_cb;
 
-            nfc->delegate()->on_size_written(true);
-        }
-    };
+    PollConfig_t _poll_config;
+    PollStatistics_t _poll_statistics;
 
-    class GetSizeCallback : public Callbacks {
-    public:
-        GetSizeCallback() { }
+#if MBED_CONF_M24SR_COMMAND_STATISTICS
+    /** frame being measured */
+    struct Sample_t {
+        Command_t command;
+        uint64_t start_us;
+        uint64_t ready_us;
+    } _sample;
 
-        virtual void on_read_byte(M24srDriver *nfc, M24srError_t status, uint16_t offset, uint8_t *bytes_read,
-                                  uint16_t read_count) {
-            if (status != M24SR_SUCCESS) {
-                nfc->delegate()->on_size_read(false, 0);
-                return;
-            }
+    CommandStatistics_t _command_statistics[COMMAND_COUNT];
+#endif
 
-            /* NDEF file size is BE */
-            nfc->_ndef_size = (((uint16_t) nfc->_ndef_size_buffer[0]) << 8 | nfc->_ndef_size_buffer[1]);
+    uint8_t _buffer[COMMAND_BUFFER_SIZE];
 
-            nfc->delegate()->on_size_read(true, nfc->_ndef_size);
-        }
-    };
+    /** Type of communication being used (SYNC, ASYNC) */
+    Communication_t _communication_type;
 
-    class EraseBytesCallback : public Callbacks {
-    public:
-        EraseBytesCallback() { }
+    /** mode set up by reset */
+    Communication_t _requested_communication_type;
 
-        virtual void on_updated_binary(M24srDriver *nfc, M24srError_t status, uint16_t offset, uint8_t *bytes_written,
-                                       uint16_t write_count) {
-            if (status != M24SR_SUCCESS) {
-                nfc->delegate()->on_bytes_erased(0);
-                return;
-            }
+    /** an M24srDriverPool polls for the answers, the driver stays in ASYNC mode without GPO nor answer check */
+    bool _pooled;
 
-            nfc->delegate()->on_bytes_erased(write_count);
-        }
-    };
+    /** event polling for the ASYNC answer if its GPO edge doesn't come, 0 if none */
+    int _answer_check_event;
+    /** when the command waiting for its ASYNC answer was sent */
+    uint64_t _answer_start_us;
 
-private:
-    /** Default password used to change the write/read permission */
-    static const uint8_t default_password[16];
+    /** a sync answer is being processed, the commands sent by the callbacks are queued */
+    bool _sync_running;
+    /** a command was sent by a callback and waits for its answer */
+    bool _sync_pending;
+    /** reset was called by a callback, it runs once the loop is over */
+    bool _reset_pending;
 
-    I2C _i2c_channel;
+    /** function of the I2C GPO */
+    NfcGpoState_t _i2c_gpo_config;
 
-    /** Interrupt object fired when the gpo status changes */
-    InterruptIn _gpo_event_interrupt;
-    DigitalIn _gpo_pin;
-    DigitalOut _rf_disable_pin;
+    /** function of the GPO during RF sessions */
+    NfcGpoState_t _rf_gpo_config;
 
-    /** object containing the callbacks to use*/
-    Callbacks *_command_cb;
+    /** set from the GPO interrupt when the RF side used the chip */
+    volatile bool _rf_activity;
 
     /**
-     * Object with private callbacks used to hide high level commands each
-     * calling multiple low level commands. This callbacks object has
-     * higher priority comparing to the user callbacks.
+     * Slot between the GPO interrupt and the event queue: set by the interrupt when it
+     * posts _gpo_event, cleared by process_gpo_edge before it looks at the chip.
+     * Both sides use atomic operations, no lock is needed between them.
      */
-    Callbacks *_subcommand_cb;
-
-    Callbacks _default_cb;
-    ManageGPOCallback _manage_gpo_cb;
-    ReadIDCallback _read_id_cb;
-    ChangePasswordRequestStatusCallback _change_password_request_status_cb;
-    RemoveAllPasswordCallback _remove_password_cb;
-    ChangeAccessStateCallback _change_access_state_cb;
-    OpenSessionCallBack _open_session_cb;
-    CloseSessionCallBack _close_session_cb;
-    WriteByteCallback _write_byte_cb;
-    ReadByteCallback _read_byte_cb;
-    SetSizeCallback _set_size_cb;
-    GetSizeCallback _get_size_cb;
-    EraseBytesCallback _erase_bytes_cb;
+    volatile bool _gpo_event_pending;
 
+    /** set by the interrupt when _gpo_event was still running and couldn't be posted */
+    volatile bool _gpo_edge_missed;
 
-    uint8_t _buffer[0xFF];
+    /** runs process_gpo_edge, allocated with the driver so that the interrupt never allocates */
+    events::UserAllocatedEvent<mbed::Callback<void()>, void()> _gpo_event;
 
-    /** Type of communication being used (SYNC, ASYNC) */
-    Communication_t _communication_type;
+    /** updated by the GPO interrupt with atomic operations */
+    GpoEventStatistics_t _gpo_event_statistics;
 
     Command_t _last_command;
     CommandData_t _last_command_data;
@@ -1467,10 +1687,66 @@ private:
     /** Buffer used to build the command to send to the chip. */
     uint16_t _ndef_size;
     uint8_t _ndef_size_buffer[NDEF_FILE_HEADER_SIZE];
+
+    /** largest NDEF message the chip can store */
+    uint16_t _ndef_capacity;
+
+#if MBED_CONF_M24SR_NDEF_SHADOW_SIZE
+    /** RAM image of the start of the NDEF message, without the length bytes */
+    uint8_t _shadow[MBED_CONF_M24SR_NDEF_SHADOW_SIZE];
+    /** one bit per block whose bytes match the chip, apart from the dirty ones */
+    uint8_t _shadow_valid[(MBED_CONF_M24SR_NDEF_SHADOW_SIZE + SHADOW_BLOCK_SIZE * 8 - 1) / (SHADOW_BLOCK_SIZE * 8)];
+    /** one bit per byte not written to the chip yet */
+    uint8_t _shadow_dirty[(MBED_CONF_M24SR_NDEF_SHADOW_SIZE + 7) / 8];
+    uint16_t _shadow_dirty_bytes;
+
+    /** true when _ndef_size matches the chip */
+    bool _ndef_size_valid;
+#endif
+
+#if MBED_CONF_M24SR_NDEF_BLOCK_HASH
+    /** CRC of each block of the NDEF message, as last read or written */
+    uint16_t _block_hash[HASH_BLOCKS];
+    /** one bit per block whose hash is known */
+    uint8_t _block_hash_valid[(HASH_BLOCKS + 7) / 8];
+#endif
+
+    /** header and CRC of the next update binary frame, the payload stays in the caller memory */
+    struct PreparedUpdate_t {
+        const uint8_t *data;
+        uint16_t offset;
+        uint8_t length;
+        uint8_t header_length; /**< 0 if no frame is ready */
+        uint8_t header[UPDATE_HEADER_SIZE];
+        uint8_t crc[2];
+    } _prepared_update;
+
     uint8_t _max_read_bytes;
     uint8_t _max_write_bytes;
     uint8_t _did_byte;
 
+    /** 8-bit I2C address of the chip */
+    uint8_t _address;
+
+    /** ISO 14443-4 block number of the last I-block sent */
+    uint8_t _block_number;
+
+    /** capability container of the tag, valid after the first session opening */
+    CapabilityContainer_t _cc;
+    bool _cc_valid;
+
+    /** system file read at reset and kept in line with the GPO changes */
+    uint8_t _system_file_buffer[SYSTEM_FILE_LENGTH];
+    SystemFile_t _system_file;
+    bool _system_file_valid;
+
+    /**
+     * Selection state of the chip in the current I2C session, a SELECT that would not
+     * change it is not sent
+     */
+    bool _application_selected;
+    uint16_t _selected_file; /**< NO_FILE_SELECTED if none or unknown */
+
     bool _is_session_open;
 };
 
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "m24sr_driver_pool.h"
+
+namespace mbed {
+namespace nfc {
+namespace vendor {
+namespace ST {
+
+M24srI2CMux::M24srI2CMux(M24srTransport &transport, uint8_t address)
+    : _transport(transport),
+      _address(address),
+      _selected(NO_CHANNEL),
+      _switches(0) {
+}
+
+int M24srI2CMux::select(uint8_t channel) {
+    if (channel == _selected) {
+        return 0;
+    }
+
+    const uint8_t control = (uint8_t) (1 << channel);
+
+    _switches++;
+    if (_transport.write(_address, &control, 1) != 0) {
+        /* the state of the multiplexer is unknown */
+        _selected = NO_CHANNEL;
+        return -1;
+    }
+
+    _selected = channel;
+    return 0;
+}
+
+int M24srMuxChannel::write(uint8_t address, const uint8_t *data, size_t length) {
+    if (_mux->select(_channel) != 0) {
+        return -1;
+    }
+
+    return _mux->transport().write(address, data, length);
+}
+
+int M24srMuxChannel::read(uint8_t address, uint8_t *data, size_t length) {
+    if (_mux->select(_channel) != 0) {
+        return -1;
+    }
+
+    return _mux->transport().read(address, data, length);
+}
+
+int M24srMuxChannel::read_scatter(uint8_t address, const M24srFragment_t *fragments, size_t count) {
+    if (_mux->select(_channel) != 0) {
+        return -1;
+    }
+
+    return _mux->transport().read_scatter(address, fragments, count);
+}
+
+int M24srMuxChannel::write_gather(uint8_t address, const M24srConstFragment_t *fragments, size_t count) {
+    if (_mux->select(_channel) != 0) {
+        return -1;
+    }
+
+    return _mux->transport().write_gather(address, fragments, count);
+}
+
+int M24srMuxChannel::poll(uint8_t address) {
+    if (_mux->select(_channel) != 0) {
+        return -1;
+    }
+
+    return _mux->transport().poll(address);
+}
+
+M24srDriverPool::M24srDriverPool(M24srTransport &transport, uint8_t mux_address)
+    : _transport(transport),
+      _mux(transport, mux_address),
+      _count(0),
+      _next(0) {
+    for (uint8_t i = 0; i < M24SR_POOL_MAX_DRIVERS; i++) {
+        _channels[i].attach(&_mux, i);
+        _drivers[i] = NULL;
+        _commands[i] = NONE;
+        _start_us[i] = 0;
+        _due_us[i] = 0;
+    }
+}
+
+bool M24srDriverPool::add(M24srDriver &driver) {
+    if (_count == M24SR_POOL_MAX_DRIVERS) {
+        return false;
+    }
+
+    /* the pool waits for the answers instead of the driver, from now on and after each reset */
+    driver._pooled = true;
+    driver._communication_type = ASYNC;
+    if (driver._answer_check_event != 0) {
+        driver.event_queue()->cancel(driver._answer_check_event);
+        driver._answer_check_event = 0;
+    }
+
+    _drivers[_count] = &driver;
+    _commands[_count] = NONE;
+    _count++;
+    return true;
+}
+
+bool M24srDriverPool::is_busy() const {
+    for (size_t i = 0; i < _count; i++) {
+        if (_drivers[i]->_last_command != NONE) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool M24srDriverPool::run_once() {
+    uint64_t now = _transport.now_us();
+    uint64_t first_due = 0;
+    bool waiting = false;
+
+    /* pick up the commands sent by the application since the last pass */
+    for (size_t i = 0; i < _count; i++) {
+        if (_drivers[i]->_last_command == NONE) {
+            _commands[i] = NONE;
+        } else if (_commands[i] == NONE) {
+            _commands[i] = _drivers[i]->_last_command;
+            _start_us[i] = now;
+            _due_us[i] = now + _drivers[i]->expected_answer_time();
+        }
+    }
+
+    for (size_t n = 0; n < _count; n++) {
+        const size_t i = (_next + n) % _count;
+        M24srDriver *driver = _drivers[i];
+
+        if (_commands[i] == NONE) {
+            continue;
+        }
+
+        if (_due_us[i] > now) {
+            if (!waiting || _due_us[i] < first_due) {
+                first_due = _due_us[i];
+            }
+            waiting = true;
+            continue;
+        }
+
+        const bool timeout = now - _start_us[i] >= driver->_poll_config.timeout_us;
+
+        driver->_poll_statistics.attempts[_commands[i]]++;
+        if (!timeout && driver->_transport->poll(driver->_address) != 0) {
+            /* still busy, the other chips go first */
+            _due_us[i] = _transport.now_us() + driver->_poll_config.interval_us;
+            now = _transport.now_us();
+            continue;
+        }
+
+        /* read the answer, or fail the operation on timeout, the driver may send its next command */
+        _next = (i + 1) % _count;
+        driver->_poll_statistics.waits[_commands[i]]++;
+        if (timeout) {
+            driver->_poll_statistics.timeouts[_commands[i]]++;
+            driver->reset_selection();
+            driver->manage_error(M24SR_IO_ERROR_I2CTIMEOUT);
+        } else {
+            driver->manage_event();
+        }
+
+        if (driver->_last_command == NONE) {
+            _commands[i] = NONE;
+        } else {
+            now = _transport.now_us();
+            _commands[i] = driver->_last_command;
+            _start_us[i] = now;
+            _due_us[i] = now + driver->expected_answer_time();
+        }
+
+        return true;
+    }
+
+    if (waiting) {
+        /* every chip is busy, nothing to do on the bus until the first one is due */
+        now = _transport.now_us();
+        if (first_due > now) {
+            _transport.wait_us((uint32_t) (first_due - now));
+        }
+        return true;
+    }
+
+    return is_busy();
+}
+
+} //ST
+} //vendor
+} //nfc
+} //mbed
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef M24SR_DRIVER_POOL_H
+#define M24SR_DRIVER_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "m24sr_transport.h"
+#include "m24sr_driver.h"
+
+namespace mbed {
+namespace nfc {
+namespace vendor {
+namespace ST {
+
+/** channels of a TCA9548 multiplexer, one tag per channel */
+#define M24SR_POOL_MAX_DRIVERS    8
+
+/** 8-bit address of a TCA9548 with its address pins low */
+#define M24SR_MUX_DEFAULT_ADDRESS 0xE0
+
+/**
+ * TCA9548 style I2C multiplexer: the byte written to its address is the set
+ * of downstream channels connected to the bus, one bit per channel.
+ */
+class M24srI2CMux {
+public:
+    /**
+     * @param transport Bus the multiplexer is on.
+     * @param address 8-bit I2C address of the multiplexer.
+     */
+    M24srI2CMux(M24srTransport &transport, uint8_t address = M24SR_MUX_DEFAULT_ADDRESS);
+
+    /**
+     * Connect a single channel, nothing is sent if it is already the connected one.
+     * @param channel Channel to connect.
+     * @return 0 on success, non-0 if the multiplexer didn't acknowledge.
+     */
+    int select(uint8_t channel);
+
+    /** Forget the connected channel, the next select writes the multiplexer again. */
+    void invalidate() {
+        _selected = NO_CHANNEL;
+    }
+
+    /** @return the bus the multiplexer is on */
+    M24srTransport &transport() {
+        return _transport;
+    }
+
+    /** @return number of channel changes written to the multiplexer */
+    uint32_t switches() const {
+        return _switches;
+    }
+
+private:
+    static const uint8_t NO_CHANNEL = 0xFF;
+
+    M24srTransport &_transport;
+    uint8_t _address;
+    uint8_t _selected;
+    uint32_t _switches;
+};
+
+/**
+ * Link to a chip behind a multiplexer, the channel is connected before each transfer.
+ */
+class M24srMuxChannel : public M24srTransport {
+public:
+    M24srMuxChannel() : _mux(NULL), _channel(0) { }
+
+    /**
+     * @param mux Multiplexer the chip is behind.
+     * @param channel Channel the chip is on.
+     */
+    void attach(M24srI2CMux *mux, uint8_t channel) {
+        _mux = mux;
+        _channel = channel;
+    }
+
+    virtual int write(uint8_t address, const uint8_t *data, size_t length);
+
+    virtual int read(uint8_t address, uint8_t *data, size_t length);
+
+    virtual int read_scatter(uint8_t address, const M24srFragment_t *fragments, size_t count);
+
+    virtual int write_gather(uint8_t address, const M24srConstFragment_t *fragments, size_t count);
+
+    virtual int poll(uint8_t address);
+
+    virtual uint64_t now_us() {
+        return _mux->transport().now_us();
+    }
+
+    virtual void wait_us(uint32_t us) {
+        _mux->transport().wait_us(us);
+    }
+
+private:
+    M24srI2CMux *_mux;
+    uint8_t _channel;
+};
+
+/**
+ * Drives up to M24SR_POOL_MAX_DRIVERS tags sharing a bus through a multiplexer,
+ * from a single thread.
+ *
+ * The drivers of the pool run in async mode without GPO: a call such as
+ * write_bytes sends the first command and returns. run() then polls the chips
+ * with a command in progress, in turn, and lets each driver process its answer
+ * and send its next command as soon as its chip is ready. While a chip
+ * programs its EEPROM the bus serves the other tags, the results are reported
+ * to each driver delegate as usual.
+ *
+ * The chips are not polled before the typical time of their command, so a busy
+ * chip costs little bus time. An answer that doesn't come within the poll
+ * timeout of the driver fails the operation with M24SR_IO_ERROR_I2CTIMEOUT.
+ */
+class M24srDriverPool {
+public:
+    /**
+     * @param transport Bus the multiplexer is on, also used as time base.
+     * @param mux_address 8-bit I2C address of the multiplexer.
+     */
+    M24srDriverPool(M24srTransport &transport, uint8_t mux_address = M24SR_MUX_DEFAULT_ADDRESS);
+
+    /**
+     * Link to give to the driver of the tag on a channel.
+     * @param channel Multiplexer channel, lower than M24SR_POOL_MAX_DRIVERS.
+     * @return the transport of this channel
+     */
+    M24srTransport &channel(uint8_t channel) {
+        return _channels[channel];
+    }
+
+    /**
+     * Let the pool complete the commands of a driver, before or after its reset.
+     * The pool owns the mode of the driver from then on: the driver stays in async
+     * mode across its resets, ignores its GPO and set_communication_mode fails.
+     * @param driver Driver built on one of the channel transports, with no command in progress.
+     * @return false if the pool is full
+     */
+    bool add(M24srDriver &driver);
+
+    /**
+     * @return true if a driver waits for the answer of its chip
+     */
+    bool is_busy() const;
+
+    /**
+     * Poll the chip that is due first and process its answer if it is ready,
+     * or wait until a chip is due.
+     * @return true if a driver still waits for its chip
+     */
+    bool run_once();
+
+    /**
+     * Process the answers until all the operations of the drivers are complete.
+     */
+    void run() {
+        while (run_once()) { }
+    }
+
+    /** @return the multiplexer */
+    M24srI2CMux &mux() {
+        return _mux;
+    }
+
+private:
+    M24srTransport &_transport;
+    M24srI2CMux _mux;
+    M24srMuxChannel _channels[M24SR_POOL_MAX_DRIVERS];
+
+    M24srDriver *_drivers[M24SR_POOL_MAX_DRIVERS];
+    size_t _count;
+
+    /** command each driver was waiting for at the last pass */
+    Command_t _commands[M24SR_POOL_MAX_DRIVERS];
+    /** when the command was seen first */
+    uint64_t _start_us[M24SR_POOL_MAX_DRIVERS];
+    /** when the chip is polled next */
+    uint64_t _due_us[M24SR_POOL_MAX_DRIVERS];
+
+    /** driver polled first when several are due, for fairness */
+    size_t _next;
+};
+
+} //ST
+} //vendor
+} //nfc
+} //mbed
+
+#endif // M24SR_DRIVER_POOL_H
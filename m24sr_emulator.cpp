@@ -0,0 +1,707 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "m24sr_emulator.h"
+#include "m24sr_crc.h"
+
+namespace mbed {
+namespace nfc {
+namespace vendor {
+namespace ST {
+
+#define GET_SESSION_COMMAND   0x26
+#define KILL_SESSION_COMMAND  0x52
+
+#define PCB_BLOCK_MASK        0xC0
+#define PCB_S_BLOCK           0xC0
+#define PCB_DID               0x08
+#define PCB_S_DESELECT        0xC2
+#define PCB_S_WTX             0xF2
+#define WTX_MULTIPLIER        0x01
+
+#define FILE_ID_CC            0xE103
+#define FILE_ID_SYSTEM        0xE101
+#define FILE_ID_NDEF          0x0001
+
+#define ACCESS_FREE           0x00
+#define ACCESS_PASSWORD       0x80
+#define ACCESS_PERMANENT      0xFF
+
+#define PASSWORD_READ         1
+#define PASSWORD_WRITE        2
+#define PASSWORD_I2C          3
+#define PASSWORD_LENGTH       16
+#define MAX_LE                0xF6
+
+#define SW_SUCCESS                0x9000
+#define SW_EOF                    0x6282
+#define SW_PASSWORD_REQUIRED      0x6300
+#define SW_PASSWORD_INCORRECT     0x63C2
+#define SW_WRONG_LENGTH           0x6700
+#define SW_INCOMPATIBLE_COMMAND   0x6981
+#define SW_SECURITY_UNSATISFIED   0x6982
+#define SW_COMMAND_NOT_ALLOWED    0x6986
+#define SW_INCORRECT_PARAMETER    0x6A80
+#define SW_FILE_NOT_FOUND         0x6A82
+#define SW_INCORRECT_P1_OR_P2     0x6A86
+#define SW_INS_NOT_SUPPORTED      0x6D00
+#define SW_CLASS_NOT_SUPPORTED    0x6E00
+
+/* byte offsets inside the CC and system files */
+#define CC_READ_ACCESS        0x0D
+#define CC_WRITE_ACCESS       0x0E
+#define SYSTEM_GPO            0x04
+#define SYSTEM_GPO_ANSWER_READY 0x03
+
+static const uint8_t ndef_application_id[] = {0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01};
+
+M24srEmulator::Timing_t M24srEmulator::default_timing() {
+    Timing_t timing;
+    timing.i2c_frequency_hz = 400000;
+    timing.command_us = 300;
+    timing.session_us = 500;
+    timing.program_base_us = 5000;
+    timing.program_us_per_byte = 20;
+    timing.wtx_threshold_us = 0;
+    return timing;
+}
+
+M24srEmulator::M24srEmulator(Model_t model, M24srVirtualClock *clock, uint8_t address)
+    : _clock(clock ? clock : &_own_clock),
+      _timing(default_timing()),
+      _address(address),
+      _i2c_session(false),
+      _rf_session(false),
+      _application_selected(false),
+      _selected_file(NO_FILE),
+      _close_after_response(false),
+      _busy_until_us(0),
+      _deferred_length(0),
+      _deferred_ready_us(0),
+      _response_length(0) {
+    uint8_t product_code;
+
+    switch (model) {
+    case M24SR02:
+        _ndef_file_size = 0x0100;
+        product_code = 0x82;
+        break;
+    case M24SR04:
+        _ndef_file_size = 0x0200;
+        product_code = 0x86;
+        break;
+    case M24SR16:
+        _ndef_file_size = 0x0800;
+        product_code = 0x85;
+        break;
+    case M24SR64:
+    default:
+        _ndef_file_size = 0x2000;
+        product_code = 0x84;
+        break;
+    }
+
+    memset(_verified, 0, sizeof(_verified));
+    memset(_passwords, 0, sizeof(_passwords));
+    memset(_ndef_file, 0, sizeof(_ndef_file));
+    reset_statistics();
+
+    const uint8_t cc_file[M24SR_EMULATOR_CC_FILE_SIZE] = {
+        0x00, 0x0F, /* CC file length */
+        0x20, /* mapping version */
+        0x00, MAX_LE, /* MLe */
+        0x00, MAX_LE, /* MLc */
+        0x04, 0x06, /* NDEF file control TLV */
+        (uint8_t) (FILE_ID_NDEF >> 8), (uint8_t) FILE_ID_NDEF,
+        (uint8_t) (_ndef_file_size >> 8), (uint8_t) _ndef_file_size,
+        ACCESS_FREE, ACCESS_FREE
+    };
+    memcpy(_cc_file, cc_file, sizeof(_cc_file));
+
+    const uint8_t system_file[M24SR_EMULATOR_SYSTEM_FILE_SIZE] = {
+        0x00, M24SR_EMULATOR_SYSTEM_FILE_SIZE, /* length */
+        0x00, /* I2C protect */
+        0x00, /* I2C watchdog */
+        0x11, /* GPO: session opened for both RF and I2C */
+        0x00, /* ST reserved */
+        0x01, /* RF enable */
+        0x00, /* NDEF file number */
+        0x02, product_code, 0x00, 0x4D, 0x32, 0x34, 0x53, /* UID */
+        (uint8_t) ((_ndef_file_size - 1) >> 8), (uint8_t) (_ndef_file_size - 1), /* memory size */
+        product_code
+    };
+    memcpy(_system_file, system_file, sizeof(_system_file));
+}
+
+void M24srEmulator::reset_statistics() {
+    memset(&_statistics, 0, sizeof(_statistics));
+}
+
+void M24srEmulator::advance_bus(size_t bytes) {
+    /* start + 9 clocks per byte (8 bits and ack) + stop */
+    const uint64_t clocks = (uint64_t) bytes * 9 + 2;
+    _clock->advance((clocks * 1000000 + _timing.i2c_frequency_hz - 1) / _timing.i2c_frequency_hz);
+}
+
+bool M24srEmulator::is_busy() const {
+    return _clock->now_us() < _busy_until_us;
+}
+
+int M24srEmulator::poll(uint8_t address) {
+    if (address != _address) {
+        return 1;
+    }
+
+    advance_bus(1);
+    _statistics.polls++;
+    _statistics.bytes_written++;
+
+    if (is_busy()) {
+        _statistics.nacks++;
+        return 1;
+    }
+
+    return 0;
+}
+
+int M24srEmulator::wait_gpo_edge(uint32_t timeout_us) {
+    const uint64_t deadline = _clock->now_us() + timeout_us;
+    const bool answer_ready = (_system_file[SYSTEM_GPO] & 0x0F) == SYSTEM_GPO_ANSWER_READY;
+
+    if (answer_ready && _i2c_session && is_busy() && _busy_until_us <= deadline) {
+        _clock->advance_to(_busy_until_us);
+        return 0;
+    }
+
+    _clock->advance_to(deadline);
+    return 1;
+}
+
+int M24srEmulator::write(uint8_t address, const uint8_t *data, size_t length) {
+    if (length == 0) {
+        return poll(address);
+    }
+
+    if (address != _address) {
+        return 1;
+    }
+
+    advance_bus(length + 1);
+    _statistics.bytes_written += length + 1;
+
+    if (is_busy()) {
+        _statistics.nacks++;
+        return 1;
+    }
+
+    if (length == 1 && (data[0] == GET_SESSION_COMMAND || data[0] == KILL_SESSION_COMMAND)) {
+        if (data[0] == GET_SESSION_COMMAND && _rf_session) {
+            _statistics.nacks++;
+            return 1;
+        }
+        _rf_session = false;
+        _i2c_session = true;
+        _busy_until_us = _clock->now_us() + _timing.session_us;
+        return 0;
+    }
+
+    if (!_i2c_session) {
+        _statistics.nacks++;
+        return 1;
+    }
+
+    /* frames without a valid CRC are silently dropped by the chip */
+    if (length < 3 || m24sr_crc16(data, length) != 0) {
+        return 0;
+    }
+
+    _statistics.frames++;
+
+    if ((data[0] & PCB_BLOCK_MASK) == PCB_S_BLOCK) {
+        process_s_block(data, length - 2);
+    } else {
+        process_i_block(data, length - 2);
+    }
+
+    return 0;
+}
+
+int M24srEmulator::read(uint8_t address, uint8_t *data, size_t length) {
+    const M24srFragment_t fragment = { data, length };
+
+    return read_scatter(address, &fragment, 1);
+}
+
+int M24srEmulator::read_scatter(uint8_t address, const M24srFragment_t *fragments, size_t count) {
+    size_t length = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        length += fragments[i].length;
+    }
+
+    if (address != _address) {
+        return 1;
+    }
+
+    advance_bus(length + 1);
+    _statistics.bytes_read += length + 1;
+
+    if (is_busy() || _response_length == 0) {
+        _statistics.nacks++;
+        return 1;
+    }
+
+    /* bytes past the response read as 0 */
+    size_t position = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < fragments[i].length; j++, position++) {
+            fragments[i].data[j] = (position < _response_length) ? _response[position] : 0;
+        }
+    }
+    _response_length = 0;
+
+    if (_close_after_response) {
+        close_session();
+    }
+
+    return 0;
+}
+
+void M24srEmulator::close_session() {
+    _close_after_response = false;
+    _i2c_session = false;
+    _application_selected = false;
+    _selected_file = NO_FILE;
+    memset(_verified, 0, sizeof(_verified));
+}
+
+void M24srEmulator::process_s_block(const uint8_t *frame, size_t length) {
+    if (frame[0] == PCB_S_DESELECT) {
+        const uint8_t response[] = {PCB_S_DESELECT};
+        queue_frame(response, sizeof(response), _clock->now_us() + _timing.command_us);
+        _close_after_response = true;
+    } else if (frame[0] == PCB_S_WTX && length == 2 && _deferred_length != 0) {
+        /* the host accepted the extension, the real answer follows the programming */
+        memcpy(_response, _deferred_response, _deferred_length);
+        _response_length = _deferred_length;
+        _busy_until_us = _deferred_ready_us;
+        _deferred_length = 0;
+    }
+}
+
+void M24srEmulator::process_i_block(const uint8_t *frame, size_t length) {
+    const uint8_t pcb = frame[0];
+    size_t header = (pcb & PCB_DID) ? 2 : 1;
+    uint8_t out[M24SR_EMULATOR_MAX_RESPONSE];
+    uint8_t out_length = 0;
+    uint32_t duration = _timing.command_us;
+    uint16_t status;
+
+    if (length < header + 4) {
+        return;
+    }
+
+    const uint8_t *apdu = frame + header;
+    const size_t body_length = length - header - 4;
+    const uint8_t *body = apdu + 4;
+    const uint16_t p1p2 = (uint16_t) ((apdu[2] << 8) | apdu[3]);
+    uint8_t lc = 0;
+    bool has_le = false;
+    uint8_t le = 0;
+
+    if (body_length == 1) {
+        has_le = true;
+        le = body[0];
+    } else if (body_length > 1) {
+        lc = body[0];
+        if (body_length == (size_t) lc + 2) {
+            has_le = true;
+            le = body[lc + 1];
+        } else if (body_length != (size_t) lc + 1) {
+            lc = 0xFF;
+        }
+    }
+
+    if (lc == 0xFF) {
+        status = SW_WRONG_LENGTH;
+    } else {
+        status = process_apdu(apdu[0], apdu[1], p1p2, lc, body + 1, has_le, le, out, &out_length, &duration);
+    }
+
+    /* the response reuses the block number (and DID) of the command */
+    uint8_t response[M24SR_EMULATOR_MAX_RESPONSE];
+    uint8_t response_length = 0;
+    memcpy(response, frame, header);
+    response_length += header;
+    memcpy(response + response_length, out, out_length);
+    response_length += out_length;
+    response[response_length++] = (uint8_t) (status >> 8);
+    response[response_length++] = (uint8_t) status;
+
+    const uint64_t ready_us = _clock->now_us() + duration;
+
+    if (_timing.wtx_threshold_us != 0 && duration > _timing.wtx_threshold_us) {
+        /* ask for more time, keep the answer until the host acknowledges */
+        const uint8_t wtx[] = {PCB_S_WTX, WTX_MULTIPLIER};
+        queue_frame(response, response_length, ready_us);
+        memcpy(_deferred_response, _response, _response_length);
+        _deferred_length = _response_length;
+        _deferred_ready_us = ready_us;
+        queue_frame(wtx, sizeof(wtx), _clock->now_us() + _timing.wtx_threshold_us);
+        _statistics.wtx_requests++;
+        return;
+    }
+
+    queue_frame(response, response_length, ready_us);
+}
+
+void M24srEmulator::queue_frame(const uint8_t *frame, uint8_t length, uint64_t ready_us) {
+    const uint16_t crc = m24sr_crc16(frame, length);
+
+    memcpy(_response, frame, length);
+    _response[length] = (uint8_t) crc;
+    _response[length + 1] = (uint8_t) (crc >> 8);
+    _response_length = length + 2;
+    _busy_until_us = ready_us;
+}
+
+uint16_t M24srEmulator::process_apdu(uint8_t cla, uint8_t ins, uint16_t p1p2, uint8_t lc, const uint8_t *data,
+                                     bool has_le, uint8_t le, uint8_t *out, uint8_t *out_length,
+                                     uint32_t *duration) {
+    const bool st = (cla == 0xA2);
+
+    if (cla != 0x00 && cla != 0xA2) {
+        return SW_CLASS_NOT_SUPPORTED;
+    }
+
+    switch (ins) {
+    case 0xA4:
+        return st ? SW_CLASS_NOT_SUPPORTED : select(p1p2, lc, data);
+    case 0xB0:
+        if (!has_le) {
+            return SW_WRONG_LENGTH;
+        }
+        return read_binary(st, p1p2, le, out, out_length);
+    case 0xD6:
+        if (st) {
+            /* SendInterrupt and StateControl */
+            return SW_SUCCESS;
+        }
+        return update_binary(p1p2, lc, data, duration);
+    case 0x20:
+        return st ? SW_CLASS_NOT_SUPPORTED : verify((uint8_t) p1p2, lc, data);
+    case 0x24:
+        if (st) {
+            return SW_CLASS_NOT_SUPPORTED;
+        }
+        if ((p1p2 != PASSWORD_READ && p1p2 != PASSWORD_WRITE) || lc != PASSWORD_LENGTH) {
+            return SW_INCORRECT_P1_OR_P2;
+        }
+        if (!_verified[PASSWORD_WRITE] && !_verified[PASSWORD_I2C]) {
+            return SW_SECURITY_UNSATISFIED;
+        }
+        memcpy(_passwords[p1p2], data, PASSWORD_LENGTH);
+        *duration += _timing.program_base_us + PASSWORD_LENGTH * _timing.program_us_per_byte;
+        _statistics.programmed_bytes += PASSWORD_LENGTH;
+        return SW_SUCCESS;
+    case 0x28:
+    case 0x26:
+        return set_access(st, ins == 0x28, (uint8_t) p1p2);
+    default:
+        return SW_INS_NOT_SUPPORTED;
+    }
+}
+
+uint16_t M24srEmulator::select(uint16_t p1p2, uint8_t lc, const uint8_t *data) {
+    if (p1p2 == 0x0400) {
+        if (lc != sizeof(ndef_application_id) || memcmp(data, ndef_application_id, lc) != 0) {
+            return SW_FILE_NOT_FOUND;
+        }
+        _application_selected = true;
+        _selected_file = NO_FILE;
+        return SW_SUCCESS;
+    }
+
+    if (p1p2 != 0x000C) {
+        return SW_INCORRECT_P1_OR_P2;
+    }
+
+    if (lc != 2) {
+        return SW_WRONG_LENGTH;
+    }
+
+    if (!_application_selected) {
+        return SW_FILE_NOT_FOUND;
+    }
+
+    switch ((data[0] << 8) | data[1]) {
+    case FILE_ID_CC:
+        _selected_file = CC_FILE;
+        break;
+    case FILE_ID_SYSTEM:
+        _selected_file = SYSTEM_FILE;
+        break;
+    case FILE_ID_NDEF:
+        _selected_file = NDEF_FILE;
+        break;
+    default:
+        _selected_file = NO_FILE;
+        return SW_FILE_NOT_FOUND;
+    }
+
+    return SW_SUCCESS;
+}
+
+uint8_t *M24srEmulator::file_data(File_t file, size_t *size) {
+    switch (file) {
+    case CC_FILE:
+        *size = sizeof(_cc_file);
+        return _cc_file;
+    case SYSTEM_FILE:
+        *size = sizeof(_system_file);
+        return _system_file;
+    case NDEF_FILE:
+        *size = _ndef_file_size;
+        return _ndef_file;
+    default:
+        *size = 0;
+        return NULL;
+    }
+}
+
+uint16_t M24srEmulator::read_binary(bool st_read, uint16_t offset, uint8_t le, uint8_t *out, uint8_t *out_length) {
+    size_t size;
+    const uint8_t *file = file_data(_selected_file, &size);
+
+    if (!file) {
+        return SW_COMMAND_NOT_ALLOWED;
+    }
+
+    if (le > MAX_LE) {
+        return SW_WRONG_LENGTH;
+    }
+
+    if (_selected_file == NDEF_FILE && _cc_file[CC_READ_ACCESS] != ACCESS_FREE && !_verified[PASSWORD_I2C]) {
+        if (_cc_file[CC_READ_ACCESS] != ACCESS_PASSWORD || !_verified[PASSWORD_READ]) {
+            return SW_SECURITY_UNSATISFIED;
+        }
+    }
+
+    if (offset >= size) {
+        return SW_INCORRECT_P1_OR_P2;
+    }
+
+    if ((size_t) offset + le > size) {
+        if (!st_read) {
+            return SW_EOF;
+        }
+        le = (uint8_t) (size - offset);
+    }
+
+    memcpy(out, file + offset, le);
+    *out_length = le;
+    return SW_SUCCESS;
+}
+
+uint16_t M24srEmulator::update_binary(uint16_t offset, uint8_t lc, const uint8_t *data, uint32_t *duration) {
+    size_t size;
+    uint8_t *file = file_data(_selected_file, &size);
+
+    if (!file) {
+        return SW_COMMAND_NOT_ALLOWED;
+    }
+
+    if (lc > MAX_LE) {
+        return SW_WRONG_LENGTH;
+    }
+
+    if (_selected_file == CC_FILE) {
+        return SW_SECURITY_UNSATISFIED;
+    }
+
+    if (_selected_file == SYSTEM_FILE && !_verified[PASSWORD_I2C]) {
+        return SW_SECURITY_UNSATISFIED;
+    }
+
+    if (_selected_file == NDEF_FILE && _cc_file[CC_WRITE_ACCESS] != ACCESS_FREE && !_verified[PASSWORD_I2C]) {
+        if (_cc_file[CC_WRITE_ACCESS] != ACCESS_PASSWORD || !_verified[PASSWORD_WRITE]) {
+            return SW_SECURITY_UNSATISFIED;
+        }
+    }
+
+    if ((size_t) offset + lc > size) {
+        return SW_INCORRECT_P1_OR_P2;
+    }
+
+    memcpy(file + offset, data, lc);
+    *duration += _timing.program_base_us + (uint32_t) lc * _timing.program_us_per_byte;
+    _statistics.programmed_bytes += lc;
+    return SW_SUCCESS;
+}
+
+uint16_t M24srEmulator::verify(uint8_t password_id, uint8_t lc, const uint8_t *data) {
+    if (password_id < PASSWORD_READ || password_id > PASSWORD_I2C) {
+        return SW_INCORRECT_PARAMETER;
+    }
+
+    if (lc == 0) {
+        /* only report whether a password is needed */
+        if (_verified[password_id]) {
+            return SW_SUCCESS;
+        }
+        if (password_id == PASSWORD_READ && _cc_file[CC_READ_ACCESS] == ACCESS_FREE) {
+            return SW_SUCCESS;
+        }
+        if (password_id == PASSWORD_WRITE && _cc_file[CC_WRITE_ACCESS] == ACCESS_FREE) {
+            return SW_SUCCESS;
+        }
+        return SW_PASSWORD_REQUIRED;
+    }
+
+    if (lc != PASSWORD_LENGTH) {
+        return SW_WRONG_LENGTH;
+    }
+
+    if (memcmp(_passwords[password_id], data, PASSWORD_LENGTH) != 0) {
+        return SW_PASSWORD_INCORRECT;
+    }
+
+    _verified[password_id] = true;
+    return SW_SUCCESS;
+}
+
+uint16_t M24srEmulator::set_access(bool st, bool enable, uint8_t password_id) {
+    uint8_t *access;
+
+    if (password_id == PASSWORD_READ) {
+        access = &_cc_file[CC_READ_ACCESS];
+    } else if (password_id == PASSWORD_WRITE) {
+        access = &_cc_file[CC_WRITE_ACCESS];
+    } else {
+        return SW_INCORRECT_P1_OR_P2;
+    }
+
+    if (st) {
+        /* permanent state, only the I2C password can lift it */
+        if (enable) {
+            if (!_verified[PASSWORD_WRITE] && !_verified[PASSWORD_I2C]) {
+                return SW_SECURITY_UNSATISFIED;
+            }
+            *access = ACCESS_PERMANENT;
+        } else {
+            if (!_verified[PASSWORD_I2C]) {
+                return SW_SECURITY_UNSATISFIED;
+            }
+            if (*access == ACCESS_PERMANENT) {
+                *access = ACCESS_PASSWORD;
+            }
+        }
+        return SW_SUCCESS;
+    }
+
+    if (!_verified[PASSWORD_WRITE] && !_verified[PASSWORD_I2C]) {
+        return SW_SECURITY_UNSATISFIED;
+    }
+
+    if (*access == ACCESS_PERMANENT) {
+        return SW_INCOMPATIBLE_COMMAND;
+    }
+
+    *access = enable ? ACCESS_PASSWORD : ACCESS_FREE;
+    return SW_SUCCESS;
+}
+
+M24srEmulatedMux::M24srEmulatedMux(M24srVirtualClock &clock, uint8_t address, uint32_t i2c_frequency_hz)
+    : _clock(clock),
+      _address(address),
+      _i2c_frequency_hz(i2c_frequency_hz),
+      _control(0) {
+    memset(_devices, 0, sizeof(_devices));
+}
+
+void M24srEmulatedMux::advance_bus(size_t bytes) {
+    const uint64_t clocks = (uint64_t) bytes * 9 + 2;
+    _clock.advance((clocks * 1000000 + _i2c_frequency_hz - 1) / _i2c_frequency_hz);
+}
+
+int M24srEmulatedMux::write(uint8_t address, const uint8_t *data, size_t length) {
+    int ret = 1;
+
+    if (address == _address) {
+        advance_bus(length + 1);
+        if (length == 1) {
+            _control = data[0];
+        }
+        return 0;
+    }
+
+    /* the selected channels are all connected to the bus, any device can acknowledge */
+    for (int i = 0; i < 8; i++) {
+        if ((_control & (1 << i)) && _devices[i] && _devices[i]->write(address, data, length) == 0) {
+            ret = 0;
+        }
+    }
+
+    return ret;
+}
+
+int M24srEmulatedMux::read(uint8_t address, uint8_t *data, size_t length) {
+    const M24srFragment_t fragment = { data, length };
+
+    return read_scatter(address, &fragment, 1);
+}
+
+int M24srEmulatedMux::read_scatter(uint8_t address, const M24srFragment_t *fragments, size_t count) {
+    if (address == _address) {
+        advance_bus(count ? fragments[0].length + 1 : 1);
+        if (count && fragments[0].length) {
+            fragments[0].data[0] = _control;
+        }
+        return 0;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        if ((_control & (1 << i)) && _devices[i] && _devices[i]->read_scatter(address, fragments, count) == 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int M24srEmulatedMux::poll(uint8_t address) {
+    int ret = 1;
+
+    if (address == _address) {
+        advance_bus(1);
+        return 0;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        if ((_control & (1 << i)) && _devices[i] && _devices[i]->poll(address) == 0) {
+            ret = 0;
+        }
+    }
+
+    return ret;
+}
+
+} //ST
+} //vendor
+} //nfc
+} //mbed
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef M24SR_EMULATOR_H
+#define M24SR_EMULATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "m24sr_transport.h"
+
+namespace mbed {
+namespace nfc {
+namespace vendor {
+namespace ST {
+
+#define M24SR_EMULATOR_MAX_NDEF_FILE_SIZE 0x2000
+#define M24SR_EMULATOR_SYSTEM_FILE_SIZE   0x12
+#define M24SR_EMULATOR_CC_FILE_SIZE       0x0F
+#define M24SR_EMULATOR_MAX_RESPONSE       0xFF
+
+/**
+ * Virtual time base. Devices sharing a bus must share the clock so that the
+ * time spent talking to one of them is seen by all the others.
+ */
+class M24srVirtualClock {
+public:
+    M24srVirtualClock() : _now_us(0) { }
+
+    /** @return current virtual time in microseconds */
+    uint64_t now_us() const {
+        return _now_us;
+    }
+
+    /** Move the time forward. */
+    void advance(uint64_t us) {
+        _now_us += us;
+    }
+
+    /** Move the time forward to the given point, if it is in the future. */
+    void advance_to(uint64_t time_us) {
+        if (time_us > _now_us) {
+            _now_us = time_us;
+        }
+    }
+
+private:
+    uint64_t _now_us;
+};
+
+/**
+ * Software model of an M24SR chip, seen through its I2C interface.
+ *
+ * It understands the frames emitted by M24srDriver (GetSession, KillSession,
+ * DESELECT and WTX S-blocks, SELECT, READ/UPDATE BINARY, VERIFY, CHANGE
+ * REFERENCE DATA, ENABLE/DISABLE VERIFICATION REQUIREMENT and PERMANENT STATE)
+ * and keeps the CC, system and NDEF files in RAM.
+ *
+ * No real time passes: every bus transfer, command and EEPROM write moves a
+ * virtual clock according to the timing model, and the chip NACKs its address
+ * for as long as it is busy, like the real part does.
+ */
+class M24srEmulator : public M24srTransport {
+public:
+    /** Supported capacities */
+    enum Model_t {
+        M24SR02, /**< 2 Kbit */
+        M24SR04, /**< 4 Kbit */
+        M24SR16, /**< 16 Kbit */
+        M24SR64  /**< 64 Kbit */
+    };
+
+    /** Timing model, all durations in microseconds */
+    struct Timing_t {
+        uint32_t i2c_frequency_hz; /**< bus clock, every transferred byte costs 9 clock cycles */
+        uint32_t command_us; /**< time to process a command that doesn't program the EEPROM */
+        uint32_t session_us; /**< time to process GetSession/KillSession */
+        uint32_t program_base_us; /**< fixed EEPROM programming cost of an UPDATE BINARY */
+        uint32_t program_us_per_byte; /**< EEPROM programming cost per written byte */
+        uint32_t wtx_threshold_us; /**< commands longer than this send a WTX request first, 0 disables WTX */
+    };
+
+    /** Counters updated by the emulator */
+    struct Statistics_t {
+        uint32_t frames; /**< I-block and S-block frames received */
+        uint32_t bytes_written; /**< bytes sent to the chip, addresses included */
+        uint32_t bytes_read; /**< bytes read from the chip, addresses included */
+        uint32_t polls; /**< bare address polls */
+        uint32_t nacks; /**< transfers refused because the chip was busy or not in session */
+        uint32_t wtx_requests; /**< WTX requests sent */
+        uint32_t programmed_bytes; /**< bytes written to the EEPROM */
+    };
+
+    /** @return timing close to the datasheet values at 400 kHz */
+    static Timing_t default_timing();
+
+    /**
+     * Build a blank chip.
+     * @param model Capacity of the chip.
+     * @param clock Shared clock, NULL to use a private one.
+     * @param address 8-bit I2C address the chip answers to.
+     */
+    M24srEmulator(Model_t model, M24srVirtualClock *clock = NULL, uint8_t address = 0xAC);
+
+    virtual ~M24srEmulator() { }
+
+    virtual int write(uint8_t address, const uint8_t *data, size_t length);
+
+    virtual int read(uint8_t address, uint8_t *data, size_t length);
+
+    virtual int read_scatter(uint8_t address, const M24srFragment_t *fragments, size_t count);
+
+    virtual int poll(uint8_t address);
+
+    virtual bool can_wait_gpo_edge() {
+        return true;
+    }
+
+    virtual int wait_gpo_edge(uint32_t timeout_us);
+
+    virtual uint64_t now_us() {
+        return _clock->now_us();
+    }
+
+    virtual void wait_us(uint32_t us) {
+        _clock->advance(us);
+    }
+
+    /** Change the timing model. */
+    void set_timing(const Timing_t &timing) {
+        _timing = timing;
+    }
+
+    /** Simulate a reader holding an RF session, GetSession is refused while it is open. */
+    void set_rf_session(bool open) {
+        _rf_session = open;
+    }
+
+    /** @return the NDEF file, 2 bytes of length followed by the message */
+    uint8_t *ndef_file() {
+        return _ndef_file;
+    }
+
+    /** @return size of the NDEF file for this model */
+    size_t ndef_file_size() const {
+        return _ndef_file_size;
+    }
+
+    /** @return the system file */
+    const uint8_t *system_file() const {
+        return _system_file;
+    }
+
+    /** @return the clock used by this chip */
+    M24srVirtualClock &clock() {
+        return *_clock;
+    }
+
+    /** @return counters since construction or the last reset_statistics */
+    const Statistics_t &statistics() const {
+        return _statistics;
+    }
+
+    void reset_statistics();
+
+private:
+    enum File_t {
+        NO_FILE,
+        CC_FILE,
+        SYSTEM_FILE,
+        NDEF_FILE
+    };
+
+    void advance_bus(size_t bytes);
+    bool is_busy() const;
+    void process_i_block(const uint8_t *frame, size_t length);
+    void process_s_block(const uint8_t *frame, size_t length);
+    uint16_t process_apdu(uint8_t cla, uint8_t ins, uint16_t p1p2, uint8_t lc, const uint8_t *data,
+                          bool has_le, uint8_t le, uint8_t *out, uint8_t *out_length, uint32_t *duration);
+    uint16_t select(uint16_t p1p2, uint8_t lc, const uint8_t *data);
+    uint16_t read_binary(bool st_read, uint16_t offset, uint8_t le, uint8_t *out, uint8_t *out_length);
+    uint16_t update_binary(uint16_t offset, uint8_t lc, const uint8_t *data, uint32_t *duration);
+    uint16_t verify(uint8_t password_id, uint8_t lc, const uint8_t *data);
+    uint16_t set_access(bool st, bool enable, uint8_t password_id);
+    uint8_t *file_data(File_t file, size_t *size);
+    void queue_frame(const uint8_t *frame, uint8_t length, uint64_t ready_us);
+    void close_session();
+
+private:
+    M24srVirtualClock _own_clock;
+    M24srVirtualClock *_clock;
+    Timing_t _timing;
+    Statistics_t _statistics;
+
+    uint8_t _address;
+    bool _i2c_session;
+    bool _rf_session;
+    bool _application_selected;
+    File_t _selected_file;
+    bool _verified[4];
+    bool _close_after_response;
+
+    /** the chip NACKs until this time */
+    uint64_t _busy_until_us;
+
+    /** answer sent after the host acknowledges a WTX request */
+    uint8_t _deferred_response[M24SR_EMULATOR_MAX_RESPONSE];
+    uint8_t _deferred_length;
+    uint64_t _deferred_ready_us;
+
+    uint8_t _response[M24SR_EMULATOR_MAX_RESPONSE];
+    uint8_t _response_length;
+
+    uint8_t _passwords[4][16];
+    uint8_t _cc_file[M24SR_EMULATOR_CC_FILE_SIZE];
+    uint8_t _system_file[M24SR_EMULATOR_SYSTEM_FILE_SIZE];
+    uint8_t _ndef_file[M24SR_EMULATOR_MAX_NDEF_FILE_SIZE];
+    size_t _ndef_file_size;
+};
+
+/**
+ * Model of a TCA9548 style I2C multiplexer with a device, usually an
+ * M24srEmulator, on each of its 8 channels. The byte written to the
+ * multiplexer address selects the channels, the other transfers go to the
+ * devices of the selected channels.
+ * The devices must use the clock given to the multiplexer.
+ */
+class M24srEmulatedMux : public M24srTransport {
+public:
+    /**
+     * @param clock Clock shared with the devices.
+     * @param address 8-bit I2C address of the multiplexer.
+     * @param i2c_frequency_hz Bus clock, used to time the accesses to the multiplexer.
+     */
+    M24srEmulatedMux(M24srVirtualClock &clock, uint8_t address = 0xE0, uint32_t i2c_frequency_hz = 400000);
+
+    virtual ~M24srEmulatedMux() { }
+
+    /** Connect a device to a channel, NULL to leave the channel empty. */
+    void attach(uint8_t channel, M24srTransport *device) {
+        _devices[channel] = device;
+    }
+
+    /** @return the selected channels, one bit per channel */
+    uint8_t control() const {
+        return _control;
+    }
+
+    virtual int write(uint8_t address, const uint8_t *data, size_t length);
+
+    virtual int read(uint8_t address, uint8_t *data, size_t length);
+
+    virtual int read_scatter(uint8_t address, const M24srFragment_t *fragments, size_t count);
+
+    virtual int poll(uint8_t address);
+
+    virtual uint64_t now_us() {
+        return _clock.now_us();
+    }
+
+    virtual void wait_us(uint32_t us) {
+        _clock.advance(us);
+    }
+
+private:
+    void advance_bus(size_t bytes);
+
+    M24srVirtualClock &_clock;
+    uint8_t _address;
+    uint32_t _i2c_frequency_hz;
+    uint8_t _control;
+    M24srTransport *_devices[8];
+};
+
+} //ST
+} //vendor
+} //nfc
+} //mbed
+
+#endif // M24SR_EMULATOR_H
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef M24SR_I2C_TRANSPORT_H
+#define M24SR_I2C_TRANSPORT_H
+
+#include "m24sr_transport.h"
+#include "I2C.h"
+#include "Timer.h"
+#include "mbed_wait_api.h"
+#if MBED_CONF_RTOS_PRESENT
+#include "rtos/ThisThread.h"
+#endif
+
+namespace mbed {
+namespace nfc {
+namespace vendor {
+namespace ST {
+
+/**
+ * Default transport, uses an mbed I2C peripheral.
+ */
+class M24srI2CTransport : public M24srTransport {
+public:
+    /**
+     * @param i2c_data_pin I2C data pin name.
+     * @param i2c_clock_pin I2C clock pin name.
+     */
+    M24srI2CTransport(PinName i2c_data_pin, PinName i2c_clock_pin)
+        : _i2c_channel(i2c_data_pin, i2c_clock_pin) {
+        _timer.start();
+    }
+
+    virtual int write(uint8_t address, const uint8_t *data, size_t length) {
+        return _i2c_channel.write(address, (const char*) data, length);
+    }
+
+    virtual int read(uint8_t address, uint8_t *data, size_t length) {
+        return _i2c_channel.read(address, (char*) data, length);
+    }
+
+    virtual int read_scatter(uint8_t address, const M24srFragment_t *fragments, size_t count) {
+        size_t left = 0;
+        int ret = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            left += fragments[i].length;
+        }
+
+        _i2c_channel.lock();
+        _i2c_channel.start();
+
+        /* 1 is the ack of the address, the chip stops acking while it is busy */
+        if (_i2c_channel.write(address | 0x01) != 1) {
+            ret = -1;
+        }
+
+        /* each byte is acked but the last one, which ends the read */
+        for (size_t i = 0; i < count && ret == 0; i++) {
+            for (size_t j = 0; j < fragments[i].length; j++) {
+                fragments[i].data[j] = (uint8_t) _i2c_channel.read(--left != 0);
+            }
+        }
+
+        _i2c_channel.stop();
+        _i2c_channel.unlock();
+        return ret;
+    }
+
+    virtual int write_gather(uint8_t address, const M24srConstFragment_t *fragments, size_t count) {
+        int ret = 0;
+
+        _i2c_channel.lock();
+        _i2c_channel.start();
+
+        /* 1 is the ack of each byte, the chip stops acking while it is busy */
+        if (_i2c_channel.write(address & 0xFE) != 1) {
+            ret = -1;
+        }
+
+        for (size_t i = 0; i < count && ret == 0; i++) {
+            for (size_t j = 0; j < fragments[i].length; j++) {
+                if (_i2c_channel.write(fragments[i].data[j]) != 1) {
+                    ret = -1;
+                    break;
+                }
+            }
+        }
+
+        _i2c_channel.stop();
+        _i2c_channel.unlock();
+        return ret;
+    }
+
+    virtual uint64_t now_us() {
+        return _timer.read_high_resolution_us();
+    }
+
+    virtual void wait_us(uint32_t us) {
+        /* the whole milliseconds let the other threads run, only the rest is a busy wait */
+        if (us >= 1000) {
+#if MBED_CONF_RTOS_PRESENT
+            rtos::ThisThread::sleep_for(us / 1000);
+#else
+            wait_ms(us / 1000);
+#endif
+            us %= 1000;
+        }
+
+        if (us != 0) {
+            ::wait_us(us);
+        }
+    }
+
+private:
+    I2C _i2c_channel;
+    Timer _timer;
+};
+
+} //ST
+} //vendor
+} //nfc
+} //mbed
+
+#endif // M24SR_I2C_TRANSPORT_H
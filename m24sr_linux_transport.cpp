@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(__linux__) && !defined(__MBED__)
+
+#include "m24sr_linux_transport.h"
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+namespace mbed {
+namespace nfc {
+namespace vendor {
+namespace ST {
+
+/** fragments of a write chained in a single transfer, more go through a copy */
+#define MAX_FRAGMENTS 4
+
+M24srLinuxTransport::M24srLinuxTransport(const char *device)
+    : _nostart(false) {
+    unsigned long functionality = 0;
+
+    _fd = open(device, O_RDWR);
+
+    if (_fd >= 0 && ioctl(_fd, I2C_FUNCS, &functionality) == 0) {
+        _nostart = (functionality & I2C_FUNC_NOSTART) != 0;
+    }
+}
+
+M24srLinuxTransport::~M24srLinuxTransport() {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+int M24srLinuxTransport::write(uint8_t address, const uint8_t *data, size_t length) {
+    return transfer(address, false, (uint8_t*) data, length);
+}
+
+int M24srLinuxTransport::read(uint8_t address, uint8_t *data, size_t length) {
+    return transfer(address, true, data, length);
+}
+
+int M24srLinuxTransport::read_scatter(uint8_t address, const M24srFragment_t *fragments, size_t count) {
+    size_t length = 0;
+
+    if (count == 1) {
+        return transfer(address, true, fragments[0].data, fragments[0].length);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        length += fragments[i].length;
+    }
+
+    if (length > sizeof(_frame)) {
+        return -1;
+    }
+
+    /* the kernel copies the message anyway, the copy out of the frame comes on top of it */
+    int ret = transfer(address, true, _frame, length);
+    if (ret != 0) {
+        return ret;
+    }
+
+    length = 0;
+    for (size_t i = 0; i < count; i++) {
+        memcpy(fragments[i].data, &_frame[length], fragments[i].length);
+        length += fragments[i].length;
+    }
+
+    return 0;
+}
+
+int M24srLinuxTransport::write_gather(uint8_t address, const M24srConstFragment_t *fragments, size_t count) {
+    struct i2c_msg messages[MAX_FRAGMENTS];
+    struct i2c_rdwr_ioctl_data transaction;
+
+    if (!_nostart || count == 0 || count > MAX_FRAGMENTS) {
+        return M24srTransport::write_gather(address, fragments, count);
+    }
+
+    if (_fd < 0) {
+        return -1;
+    }
+
+    /* the following messages continue the first one without start condition nor address */
+    for (size_t i = 0; i < count; i++) {
+        messages[i].addr = address >> 1;
+        messages[i].flags = (uint16_t) (i ? I2C_M_NOSTART : 0);
+        messages[i].len = (uint16_t) fragments[i].length;
+        messages[i].buf = (uint8_t*) fragments[i].data;
+    }
+
+    transaction.msgs = messages;
+    transaction.nmsgs = count;
+
+    if (ioctl(_fd, I2C_RDWR, &transaction) != (int) count) {
+        return -1;
+    }
+
+    return 0;
+}
+
+uint64_t M24srLinuxTransport::now_us() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void M24srLinuxTransport::wait_us(uint32_t us) {
+    usleep(us);
+}
+
+int M24srLinuxTransport::transfer(uint8_t address, bool read, uint8_t *data, size_t length) {
+    struct i2c_msg message;
+    struct i2c_rdwr_ioctl_data transaction;
+
+    if (_fd < 0) {
+        return -1;
+    }
+
+    /* i2c-dev uses 7-bit addresses, a zero length write is a bare address poll */
+    message.addr = address >> 1;
+    message.flags = read ? I2C_M_RD : 0;
+    message.len = (uint16_t) length;
+    message.buf = data;
+
+    transaction.msgs = &message;
+    transaction.nmsgs = 1;
+
+    if (ioctl(_fd, I2C_RDWR, &transaction) != 1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+} //ST
+} //vendor
+} //nfc
+} //mbed
+
+#endif // __linux__ && !__MBED__
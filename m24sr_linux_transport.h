@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef M24SR_LINUX_TRANSPORT_H
+#define M24SR_LINUX_TRANSPORT_H
+
+#include "m24sr_transport.h"
+
+namespace mbed {
+namespace nfc {
+namespace vendor {
+namespace ST {
+
+/**
+ * Host transport using the Linux i2c-dev interface, for running the driver
+ * against a chip wired to a Linux machine (e.g. through a USB-I2C bridge).
+ * Only available when building for Linux.
+ * A response is read in a single message: the adapter NACKs the last byte of
+ * each read message, which would stop the chip in the middle of a chained read.
+ */
+class M24srLinuxTransport : public M24srTransport {
+public:
+    /**
+     * Open the bus.
+     * @param device Path of the i2c-dev node, e.g. "/dev/i2c-1".
+     */
+    M24srLinuxTransport(const char *device);
+
+    virtual ~M24srLinuxTransport();
+
+    /**
+     * @return true if the bus could be opened.
+     */
+    bool is_open() const {
+        return _fd >= 0;
+    }
+
+    virtual int write(uint8_t address, const uint8_t *data, size_t length);
+
+    virtual int read(uint8_t address, uint8_t *data, size_t length);
+
+    virtual int read_scatter(uint8_t address, const M24srFragment_t *fragments, size_t count);
+
+    virtual int write_gather(uint8_t address, const M24srConstFragment_t *fragments, size_t count);
+
+    virtual uint64_t now_us();
+
+    virtual void wait_us(uint32_t us);
+
+private:
+    int transfer(uint8_t address, bool read, uint8_t *data, size_t length);
+
+    int _fd;
+
+    /** the adapter can chain messages without a new start condition */
+    bool _nostart;
+
+    /** response of a scattered read, which can't be split in several read messages */
+    uint8_t _frame[M24SR_TRANSPORT_MAX_FRAME];
+};
+
+} //ST
+} //vendor
+} //nfc
+} //mbed
+
+#endif // M24SR_LINUX_TRANSPORT_H
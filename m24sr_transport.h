@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef M24SR_TRANSPORT_H
+#define M24SR_TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace mbed {
+namespace nfc {
+namespace vendor {
+namespace ST {
+
+/** largest frame exchanged with the chip */
+#define M24SR_TRANSPORT_MAX_FRAME 0xFF
+
+/**
+ * Part of a frame received by M24srTransport::read_scatter.
+ */
+struct M24srFragment_t {
+    uint8_t *data; /**< where to store the bytes */
+    size_t length; /**< number of bytes */
+};
+
+/**
+ * Part of a frame sent by M24srTransport::write_gather.
+ */
+struct M24srConstFragment_t {
+    const uint8_t *data; /**< bytes to send */
+    size_t length; /**< number of bytes */
+};
+
+/**
+ * Link used by M24srDriver to exchange frames with the chip.
+ * Addresses are 8-bit I2C addresses, as used by mbed::I2C.
+ * All the functions return 0 on success (the chip acknowledged), like mbed::I2C.
+ */
+class M24srTransport {
+public:
+    virtual ~M24srTransport() { }
+
+    /**
+     * Send a complete frame in a single I2C transaction.
+     * @param address Address of the chip.
+     * @param data Frame to send.
+     * @param length Number of bytes in the frame.
+     * @return 0 on success, non-0 on NACK or bus error.
+     */
+    virtual int write(uint8_t address, const uint8_t *data, size_t length) = 0;
+
+    /**
+     * Read a response in a single I2C transaction.
+     * @param address Address of the chip.
+     * @param data Buffer to store the response into.
+     * @param length Number of bytes to read.
+     * @return 0 on success, non-0 on NACK or bus error.
+     */
+    virtual int read(uint8_t address, uint8_t *data, size_t length) = 0;
+
+    /**
+     * Read a response in a single I2C transaction, the bytes are stored in
+     * the fragments one after the other. The driver reads READ BINARY answers
+     * this way, the data going straight to the caller buffer: store the bytes
+     * in place rather than through a copy of the frame.
+     * @param address Address of the chip.
+     * @param fragments Buffers to fill, in order.
+     * @param count Number of fragments.
+     * @return 0 on success, non-0 on NACK or bus error.
+     */
+    virtual int read_scatter(uint8_t address, const M24srFragment_t *fragments, size_t count) = 0;
+
+    /**
+     * Send a frame made of several fragments in a single I2C transaction.
+     * The default implementation copies the frame on the stack then writes it,
+     * transports able to write byte by byte should send the bytes in place.
+     * @param address Address of the chip.
+     * @param fragments Parts of the frame, in order.
+     * @param count Number of fragments.
+     * @return 0 on success, non-0 on NACK or bus error.
+     */
+    virtual int write_gather(uint8_t address, const M24srConstFragment_t *fragments, size_t count) {
+        uint8_t frame[M24SR_TRANSPORT_MAX_FRAME];
+        size_t length = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            if (length + fragments[i].length > sizeof(frame)) {
+                return -1;
+            }
+            memcpy(&frame[length], fragments[i].data, fragments[i].length);
+            length += fragments[i].length;
+        }
+
+        return write(address, frame, length);
+    }
+
+    /**
+     * Send the address alone, the chip acknowledges it once the answer is ready.
+     * @param address Address of the chip.
+     * @return 0 if the chip acknowledged, non-0 if it is still busy.
+     */
+    virtual int poll(uint8_t address) {
+        return write(address, NULL, 0);
+    }
+
+    /**
+     * Time base used to bound the waits for the chip.
+     * @return a monotonic time in microseconds.
+     */
+    virtual uint64_t now_us() = 0;
+
+    /**
+     * Wait before talking to the chip again. The POLL_SLEEP and POLL_BACKOFF
+     * strategies rely on it to leave the CPU to other work: sleep rather than spin
+     * whenever the platform allows it.
+     * @param us Time to wait in microseconds.
+     */
+    virtual void wait_us(uint32_t us) = 0;
+
+    /**
+     * @return true if wait_gpo_edge sees the GPO line. POLL_GPO only sets the
+     * chip GPO up for transports which do.
+     */
+    virtual bool can_wait_gpo_edge() {
+        return false;
+    }
+
+    /**
+     * Wait for a falling edge on the GPO line.
+     * @param timeout_us Maximum time to wait.
+     * @return 0 if the edge was seen, 1 on timeout, -1 if the transport has no access to the GPO.
+     */
+    virtual int wait_gpo_edge(uint32_t timeout_us) {
+        (void) timeout_us;
+        return -1;
+    }
+};
+
+} //ST
+} //vendor
+} //nfc
+} //mbed
+
+#endif // M24SR_TRANSPORT_H
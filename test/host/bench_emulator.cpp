@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Each emulated model in SYNC mode at 400 kHz, in virtual time: the latency of
+ * start_session, with and without the capability container cached, and the
+ * bytes per second of read_bytes and write_bytes over the whole NDEF file.
+ * Then the CPU time per KB written and read, in SYNC and ASYNC mode.
+ */
+
+#include <functional>
+#include <vector>
+#include "m24sr_emulator.h"
+#include "test_driver.h"
+
+using namespace mbed::nfc::vendor::ST;
+
+/* @return bytes per second of count bytes transferred in time_us */
+static double rate(size_t count, uint64_t time_us) {
+    return time_us ? count * 1000000.0 / time_us : 0;
+}
+
+static void bench(M24srEmulator::Model_t model, const char *name) {
+    M24srEmulator chip(model);
+    M24srDriver driver(chip);
+    RecordingDelegate delegate;
+    M24srVirtualClock &clock = chip.clock();
+
+    driver.set_delegate(&delegate);
+    driver.reset();
+
+    uint64_t start = clock.now_us();
+    driver.start_session(true);
+    const uint64_t first_session = clock.now_us() - start;
+    CHECK(delegate.started == 1);
+
+    /* the message fills the NDEF file, after its 2 bytes of length */
+    const size_t size = driver.read_max_size();
+    std::vector<uint8_t> data(size), back(size);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (uint8_t) (i * 7 + 3);
+    }
+
+    start = clock.now_us();
+    driver.write_bytes(0, data.data(), size);
+    const uint64_t write = clock.now_us() - start;
+
+    start = clock.now_us();
+    driver.read_bytes(0, back.data(), size);
+    const uint64_t read = clock.now_us() - start;
+
+    CHECK(delegate.written == (long) size && delegate.read == (long) size && back == data);
+    driver.end_session();
+    CHECK(delegate.ended == 1);
+
+    delegate.started = -1;
+    start = clock.now_us();
+    driver.start_session(true);
+    const uint64_t next_session = clock.now_us() - start;
+    CHECK(delegate.started == 1 && next_session < first_session);
+    driver.end_session();
+
+    printf("  %s: %5u bytes, start_session %4llu us (CC cached %4llu us), write %6.0f bytes/s, read %6.0f bytes/s\n",
+           name, (unsigned) size, (unsigned long long) first_session, (unsigned long long) next_session,
+           rate(size, write), rate(size, read));
+}
+
+static const PinName gpo_pin = (PinName) 5;
+
+/* counts the time the driver leaves to the other threads through wait_us */
+class SleepMeter : public M24srEmulator {
+public:
+    SleepMeter() : M24srEmulator(M24SR64), slept(0) { }
+
+    virtual void wait_us(uint32_t us) {
+        slept += us;
+        M24srEmulator::wait_us(us);
+    }
+
+    uint64_t slept;
+};
+
+/* @return time the driver was not waiting for the chip: in ASYNC mode it returns once a
+ * command is sent, the events run the answers */
+template <typename T>
+static uint64_t busy_time(SleepMeter &chip, events::EventQueue &queue, const T &result,
+                          const std::function<void()> &operation) {
+    const uint64_t start = chip.now_us();
+    uint64_t idle = 0;
+
+    chip.slept = 0;
+    operation();
+
+    while (result == -1) {
+        /* the CPU is free until the GPO signals the answer */
+        const uint64_t wait = chip.now_us();
+        if (chip.wait_gpo_edge(1000000) != 0) {
+            break;
+        }
+        idle += chip.now_us() - wait;
+        InterruptIn::fire_pin(gpo_pin);
+        queue.dispatch();
+    }
+
+    return chip.now_us() - start - idle - chip.slept;
+}
+
+/* prints the CPU time per KB written and read in a mode, @return the one of the write in us */
+static uint64_t bench_cpu(const char *name, Communication_t mode, PollStrategy_t strategy) {
+    SleepMeter chip;
+    M24srDriver driver(chip, gpo_pin);
+    RecordingDelegate delegate;
+    events::EventQueue queue;
+    PollConfig_t config = { strategy, 100000, 100, 2000 };
+    std::vector<uint8_t> data(4096), back(4096);
+
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (uint8_t) (i * 3);
+    }
+
+    driver.set_delegate(&delegate);
+    driver.set_event_queue(&queue);
+    driver.set_poll_config(config);
+    driver.reset();
+    CHECK(driver.set_communication_mode(mode) == M24SR_SUCCESS);
+
+    busy_time(chip, queue, delegate.started, [&] { driver.start_session(true); });
+    CHECK(delegate.started == 1);
+
+    const uint64_t start = chip.now_us();
+    const uint64_t write = busy_time(chip, queue, delegate.written, [&] {
+        driver.write_bytes(0, data.data(), data.size());
+    });
+    const uint64_t read = busy_time(chip, queue, delegate.read, [&] {
+        driver.read_bytes(0, back.data(), back.size());
+    });
+    const uint64_t time = chip.now_us() - start;
+    CHECK(delegate.written == (long) data.size() && delegate.read == (long) back.size() && back == data);
+
+    printf("  %s: CPU %.1f ms per KB written, %.1f ms per KB read, %.1f ms for both\n", name,
+           write / 4000.0, read / 4000.0, time / 1000.0);
+    return write / 4;
+}
+
+int main() {
+    printf("SYNC mode at 400 kHz, whole NDEF file\n");
+    bench(M24srEmulator::M24SR02, "M24SR02");
+    bench(M24srEmulator::M24SR04, "M24SR04");
+    bench(M24srEmulator::M24SR16, "M24SR16");
+    bench(M24srEmulator::M24SR64, "M24SR64");
+
+    printf("CPU time of 4 KB written then read on an M24SR64 at 400 kHz\n");
+    const uint64_t spin = bench_cpu("SYNC, polls back to back", SYNC, POLL_SPIN);
+    const uint64_t sleep = bench_cpu("SYNC, polls every 100 us", SYNC, POLL_SLEEP);
+    const uint64_t async = bench_cpu("ASYNC", ASYNC, POLL_SPIN);
+    /* only the bus transfers cost CPU in ASYNC mode */
+    CHECK(async < sleep && sleep < spin);
+
+    return TEST_EXIT();
+}
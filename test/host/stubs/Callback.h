@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef M24SR_STUB_CALLBACK_H
+#define M24SR_STUB_CALLBACK_H
+
+#include <functional>
+
+namespace mbed {
+
+template <typename F>
+class Callback;
+
+template <typename R, typename... Args>
+class Callback<R(Args...)> {
+public:
+    Callback() { }
+
+    Callback(std::nullptr_t) { }
+
+    Callback(R (*function)(Args...)) {
+        if (function) {
+            _function = function;
+        }
+    }
+
+    template <typename T, typename M>
+    Callback(T *object, M method) {
+        _function = [object, method](Args... args) { return (object->*method)(args...); };
+    }
+
+    template <typename L>
+    Callback(L lambda) : _function(lambda) { }
+
+    R operator()(Args... args) const { return _function(args...); }
+
+    R call(Args... args) const { return _function(args...); }
+
+    explicit operator bool() const { return (bool) _function; }
+
+private:
+    std::function<R(Args...)> _function;
+};
+
+template <typename T, typename M>
+Callback<void()> callback(T *object, M method) {
+    return Callback<void()>(object, method);
+}
+
+} // namespace mbed
+
+#endif // M24SR_STUB_CALLBACK_H
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef M24SR_STUB_EVENTQUEUE_H
+#define M24SR_STUB_EVENTQUEUE_H
+
+#include <functional>
+#include <vector>
+
+namespace events {
+
+/**
+ * Event queue run by hand: dispatch runs the posted events, run_timed the
+ * first delayed one, whatever its delay. fail_calls makes call fail as when
+ * the queue is out of memory.
+ */
+class EventQueue {
+public:
+    EventQueue() : fail_calls(false), _next_id(0) { }
+
+    template <typename T, typename R>
+    int call(T *object, R (T::*method)()) {
+        if (fail_calls) {
+            return 0;
+        }
+        Posted posted = { ++_next_id, [object, method]() { (object->*method)(); } };
+        _events.push_back(posted);
+        return _next_id;
+    }
+
+    template <typename T, typename R>
+    int call_in(int ms, T *object, R (T::*method)()) {
+        Timed timed = { ++_next_id, ms, [object, method]() { (object->*method)(); } };
+        _timed.push_back(timed);
+        return _next_id;
+    }
+
+    /** post an event of its own memory, as UserAllocatedEvent does, whatever fail_calls */
+    int post(const std::function<void()> &event) {
+        Posted posted = { ++_next_id, event };
+        _events.push_back(posted);
+        return _next_id;
+    }
+
+    bool cancel(int id) {
+        for (size_t i = 0; i < _events.size(); i++) {
+            if (_events[i].id == id) {
+                _events.erase(_events.begin() + i);
+                return true;
+            }
+        }
+        for (size_t i = 0; i < _timed.size(); i++) {
+            if (_timed[i].id == id) {
+                _timed.erase(_timed.begin() + i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void dispatch(int = 0) {
+        while (!_events.empty()) {
+            std::function<void()> event = _events.front().event;
+            _events.erase(_events.begin());
+            event();
+        }
+    }
+
+    /** @return delay in ms of the first delayed event, -1 if there is none */
+    int next_timed() const {
+        return _timed.empty() ? -1 : _timed.front().ms;
+    }
+
+    /** run the first delayed event, @return its delay in ms or -1 if there is none */
+    int run_timed() {
+        if (_timed.empty()) {
+            return -1;
+        }
+        Timed timed = _timed.front();
+        _timed.erase(_timed.begin());
+        timed.event();
+        return timed.ms;
+    }
+
+    size_t pending() const {
+        return _events.size();
+    }
+
+    bool fail_calls;
+
+private:
+    struct Posted {
+        int id;
+        std::function<void()> event;
+    };
+
+    struct Timed {
+        int id;
+        int ms;
+        std::function<void()> event;
+    };
+
+    std::vector<Posted> _events;
+    std::vector<Timed> _timed;
+    int _next_id;
+};
+
+} // namespace events
+
+#endif // M24SR_STUB_EVENTQUEUE_H
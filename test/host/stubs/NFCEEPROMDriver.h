@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef M24SR_STUB_NFCEEPROMDRIVER_H
+#define M24SR_STUB_NFCEEPROMDRIVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "EventQueue.h"
+
+namespace mbed {
+namespace nfc {
+
+class NFCEEPROMDriver {
+public:
+    NFCEEPROMDriver() : _delegate(NULL), _event_queue(NULL) { }
+
+    virtual ~NFCEEPROMDriver() { }
+
+    struct Delegate {
+        virtual void on_session_started(bool success) = 0;
+        virtual void on_session_ended(bool success) = 0;
+        virtual void on_bytes_read(size_t count) = 0;
+        virtual void on_bytes_written(size_t count) = 0;
+        virtual void on_size_written(bool success) = 0;
+        virtual void on_size_read(bool success, size_t size) = 0;
+        virtual void on_bytes_erased(size_t count) = 0;
+
+    protected:
+        ~Delegate() { }
+    };
+
+    void set_delegate(Delegate *delegate) { _delegate = delegate; }
+
+    void set_event_queue(events::EventQueue *queue) { _event_queue = queue; }
+
+    virtual void reset() = 0;
+    virtual size_t read_max_size() = 0;
+    virtual void start_session(bool force = true) = 0;
+    virtual void end_session() = 0;
+    virtual void read_bytes(uint32_t address, uint8_t *bytes, size_t count) = 0;
+    virtual void write_bytes(uint32_t address, const uint8_t *bytes, size_t count) = 0;
+    virtual void write_size(size_t count) = 0;
+    virtual void read_size() = 0;
+    virtual void erase_bytes(uint32_t address, size_t size) = 0;
+
+protected:
+    Delegate *delegate() { return _delegate; }
+
+    events::EventQueue *event_queue() { return _event_queue; }
+
+private:
+    Delegate *_delegate;
+    events::EventQueue *_event_queue;
+};
+
+} // namespace nfc
+} // namespace mbed
+
+#endif // M24SR_STUB_NFCEEPROMDRIVER_H
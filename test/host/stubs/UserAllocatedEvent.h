@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef M24SR_STUB_USERALLOCATEDEVENT_H
+#define M24SR_STUB_USERALLOCATEDEVENT_H
+
+#include "EventQueue.h"
+
+namespace events {
+
+template <typename F, typename A>
+class UserAllocatedEvent;
+
+/**
+ * Event stored by its owner: posting it takes no memory from the queue, and it
+ * can't be posted again until it has run, the callback included, or is cancelled.
+ */
+template <typename F>
+class UserAllocatedEvent<F, void()> {
+public:
+    UserAllocatedEvent(F f) : _f(f), _queue(NULL), _id(0) { }
+
+    bool try_call_on(EventQueue *queue) {
+        if (_id != 0) {
+            return false;
+        }
+        _queue = queue;
+        _id = queue->post([this]() {
+            _f();
+            _id = 0;
+        });
+        return true;
+    }
+
+    bool cancel() {
+        if (_id == 0 || !_queue->cancel(_id)) {
+            return false;
+        }
+        _id = 0;
+        return true;
+    }
+
+private:
+    F _f;
+    EventQueue *_queue;
+    int _id;
+};
+
+} // namespace events
+
+#endif // M24SR_STUB_USERALLOCATEDEVENT_H
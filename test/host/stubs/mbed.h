@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef M24SR_STUB_MBED_H
+#define M24SR_STUB_MBED_H
+
+/*
+ * The parts of mbed-os used by the driver, enough to build and run it on a host.
+ * The pins do nothing, tests call InterruptIn::fire or fire_pin to simulate a GPO edge.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include <vector>
+#include "Callback.h"
+#include "mbed_atomic.h"
+#include "EventQueue.h"
+#include "mbed_wait_api.h"
+
+#define MBED_ASSERT(expr) assert(expr)
+
+typedef int PinName;
+
+#define NC      ((PinName) -1)
+#define PullUp  1
+
+namespace mbed {
+
+class DigitalIn {
+public:
+    DigitalIn(PinName pin) : _pin(pin) { }
+    int is_connected() { return _pin != NC; }
+    int read() { return 1; }
+    operator int() { return read(); }
+
+private:
+    PinName _pin;
+};
+
+class DigitalOut {
+public:
+    DigitalOut(PinName pin) : _pin(pin), _value(0) { }
+    int is_connected() { return _pin != NC; }
+    DigitalOut &operator=(int value) { _value = value; return *this; }
+    operator int() { return _value; }
+
+private:
+    PinName _pin;
+    int _value;
+};
+
+class InterruptIn {
+public:
+    InterruptIn(PinName pin) : _pin(pin), _enabled(false) {
+        /* as gpio_irq_init on several targets */
+        assert(pin != NC);
+        instances().push_back(this);
+    }
+
+    ~InterruptIn() {
+        instances().erase(std::find(instances().begin(), instances().end(), this));
+    }
+
+    void fall(Callback<void()> handler) { _fall = handler; }
+    void rise(Callback<void()> handler) { _rise = handler; }
+    void mode(int) { }
+    void enable_irq() { _enabled = true; }
+    void disable_irq() { _enabled = false; }
+
+    /** run the falling edge handler as the interrupt would */
+    void fire() {
+        if (_enabled && _fall) {
+            _fall();
+        }
+    }
+
+    /** run the falling edge handlers of every InterruptIn on the pin */
+    static void fire_pin(PinName pin) {
+        std::vector<InterruptIn *> on_pin;
+        for (size_t i = 0; i < instances().size(); i++) {
+            if (instances()[i]->_pin == pin) {
+                on_pin.push_back(instances()[i]);
+            }
+        }
+        for (size_t i = 0; i < on_pin.size(); i++) {
+            on_pin[i]->fire();
+        }
+    }
+
+private:
+    static std::vector<InterruptIn *> &instances() {
+        static std::vector<InterruptIn *> all;
+        return all;
+    }
+
+    PinName _pin;
+    Callback<void()> _fall;
+    Callback<void()> _rise;
+    bool _enabled;
+};
+
+} // namespace mbed
+
+using namespace mbed;
+
+#endif // M24SR_STUB_MBED_H
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef M24SR_HOST_TEST_H
+#define M24SR_HOST_TEST_H
+
+#include <stdio.h>
+
+/**
+ * Minimal checks for the host tests: a failed CHECK is reported and counted,
+ * TEST_EXIT prints the verdict and gives the exit status of the test program.
+ */
+static int test_failures = 0;
+
+#define CHECK(x) do { \
+        if (!(x)) { \
+            printf("FAIL %s:%d %s\n", __FILE__, __LINE__, #x); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_EXIT() (printf(test_failures ? "FAILED\n" : "OK\n"), test_failures != 0)
+
+#endif // M24SR_HOST_TEST_H
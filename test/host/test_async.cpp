@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ASYNC mode without any GPO edge: the answers must be found by the polls
+ * the driver schedules on its event queue, and the mode set by a GPO request
+ * must be the one the next reset sets up. With edges, the interrupt must not
+ * take memory from the queue, even when an edge comes while its event runs.
+ */
+
+#include "m24sr_emulator.h"
+#include "test_driver.h"
+
+using namespace mbed::nfc::vendor::ST;
+
+/* run the answer checks of the driver as the event queue would, @return false if none was armed */
+template <typename T>
+static bool run_answer_checks(M24srEmulator &chip, events::EventQueue &queue, const T &result) {
+    for (int checks = 0; result == -1; checks++) {
+        const int delay_ms = queue.next_timed();
+        if (delay_ms < 0 || checks > 10000) {
+            return false;
+        }
+        chip.clock().advance((uint64_t) delay_ms * 1000);
+        queue.run_timed();
+        queue.dispatch();
+    }
+    return true;
+}
+
+static const PinName gpo_pin = (PinName) 5;
+
+/* signals each answer on the GPO as soon as the command is sent, as a fast chip would */
+class EdgeProbe : public M24srEmulator {
+public:
+    EdgeProbe() : M24srEmulator(M24SR64), armed(false) { }
+
+    virtual int write(uint8_t address, const uint8_t *data, size_t length) {
+        const int result = M24srEmulator::write(address, data, length);
+        if (armed && result == 0 && length > 0 && wait_gpo_edge(1000000) == 0) {
+            InterruptIn::fire_pin(gpo_pin);
+        }
+        return result;
+    }
+
+    bool armed;
+};
+
+int main() {
+    M24srEmulator chip(M24srEmulator::M24SR64);
+    M24srDriver driver(chip, gpo_pin);
+    RecordingDelegate delegate;
+    events::EventQueue queue;
+    static uint8_t data[1000], back[1000];
+    SystemFile_t system_file;
+
+    driver.set_delegate(&delegate);
+    driver.set_event_queue(&queue);
+    driver.reset();
+    /* sync by default */
+    CHECK(driver.get_communication_mode() == SYNC);
+    CHECK(driver.set_communication_mode(ASYNC) == M24SR_SUCCESS);
+    CHECK(driver.get_communication_mode() == ASYNC);
+    CHECK(driver.get_system_file(&system_file) && (system_file.gpo & 0x0F) == I2C_ANSWER_READY);
+
+    /* no edge is ever fired */
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) (i * 7 + 1);
+    }
+    driver.start_session(true);
+    CHECK(run_answer_checks(chip, queue, delegate.started));
+    CHECK(delegate.started == 1);
+
+    driver.reset_poll_statistics();
+    driver.write_bytes(0, data, sizeof(data));
+    CHECK(run_answer_checks(chip, queue, delegate.written));
+    CHECK(delegate.written == (long) sizeof(data));
+    driver.read_bytes(0, back, sizeof(back));
+    CHECK(run_answer_checks(chip, queue, delegate.read));
+    CHECK(delegate.read == (long) sizeof(back) && memcmp(back, data, sizeof(data)) == 0);
+    /* each command answered through a poll */
+    CHECK(driver.poll_statistics().gpo_fallbacks >= 10);
+    printf("answers found by polling: %u\n", (unsigned) driver.poll_statistics().gpo_fallbacks);
+
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+    /* a GPO request selects the mode, and the next reset keeps it */
+    M24srError_t status = M24SR_ERROR;
+    Request_t request = Request_t();
+    RequestCallback_t done = [&](M24srError_t result, size_t) { status = result; };
+    long completed = -1;
+    RequestCallback_t async_done = [&](M24srError_t result, size_t) { status = result; completed = 1; };
+
+    request.type = REQUEST_I2C_GPO;
+    request.gpo = HIGH_IMPEDANCE;
+    driver.submit(request, async_done);
+    CHECK(run_answer_checks(chip, queue, completed));
+    CHECK(status == M24SR_SUCCESS && driver.get_communication_mode() == SYNC);
+    driver.reset();
+    CHECK(driver.get_communication_mode() == SYNC);
+    CHECK(driver.get_system_file(&system_file) && (system_file.gpo & 0x0F) == HIGH_IMPEDANCE);
+
+    delegate.started = -1;
+    driver.start_session(true);
+    CHECK(delegate.started == 1);
+    request.gpo = I2C_ANSWER_READY;
+    driver.submit(request, done);
+    CHECK(status == M24SR_SUCCESS && driver.get_communication_mode() == ASYNC);
+    driver.reset();
+    CHECK(driver.get_communication_mode() == ASYNC);
+    CHECK(driver.get_system_file(&system_file) && (system_file.gpo & 0x0F) == I2C_ANSWER_READY);
+
+    delegate.started = -1;
+    driver.start_session(true);
+    CHECK(run_answer_checks(chip, queue, delegate.started));
+    CHECK(delegate.started == 1);
+
+    {
+        /* a reset completes the request in progress and the queued ones, their callbacks can submit again */
+        M24srError_t results[3] = { M24SR_SUCCESS, M24SR_SUCCESS, M24SR_SUCCESS };
+        size_t calls = 0;
+        long started = -1;
+        Request_t start_request = Request_t();
+        start_request.type = REQUEST_START_SESSION;
+        RequestCallback_t cancelled = [&](M24srError_t result, size_t) {
+            if (calls < 3) {
+                results[calls] = result;
+            }
+            if (++calls == 3) {
+                driver.submit(start_request, [&](M24srError_t result, size_t) { started = result; });
+            }
+        };
+
+        driver.end_session();
+        CHECK(run_answer_checks(chip, queue, delegate.ended));
+        request.type = REQUEST_START_SESSION;
+        driver.submit(request, cancelled);
+        request.type = REQUEST_WRITE_BYTES;
+        request.data = data;
+        request.count = sizeof(data);
+        driver.submit(request, cancelled);
+        request.type = REQUEST_END_SESSION;
+        driver.submit(request, cancelled);
+        CHECK(driver.pending_requests() == 3);
+
+        driver.reset();
+        CHECK(calls == 3);
+        CHECK(results[0] == M24SR_IO_ERROR_CANCELLED && results[1] == M24SR_IO_ERROR_CANCELLED &&
+              results[2] == M24SR_IO_ERROR_CANCELLED);
+        /* the request submitted by a cancelled one runs after the set up */
+        CHECK(run_answer_checks(chip, queue, started));
+        CHECK(started == M24SR_SUCCESS && driver.pending_requests() == 0);
+
+        delegate.started = -1;
+        driver.start_session(true);
+        CHECK(run_answer_checks(chip, queue, delegate.started));
+        CHECK(delegate.started == 1);
+        delegate.ended = -1;
+    }
+#endif
+
+    driver.end_session();
+    CHECK(run_answer_checks(chip, queue, delegate.ended));
+    CHECK(delegate.ended == 1 && queue.next_timed() == -1);
+
+    {
+        /* the edges of the commands sent by the event come while it runs, it takes them itself */
+        EdgeProbe chip;
+        M24srDriver driver(chip, gpo_pin);
+        RecordingDelegate delegate;
+        events::EventQueue queue;
+
+        driver.set_delegate(&delegate);
+        driver.set_event_queue(&queue);
+        driver.reset();
+        CHECK(driver.set_communication_mode(ASYNC) == M24SR_SUCCESS);
+        chip.armed = true;
+        /* an allocation from the queue would fail */
+        queue.fail_calls = true;
+
+        driver.start_session(true);
+        queue.dispatch();
+        CHECK(delegate.started == 1);
+        driver.reset_poll_statistics();
+        driver.reset_gpo_event_statistics();
+        driver.write_bytes(0, data, sizeof(data));
+        CHECK(queue.pending() == 1);
+        queue.dispatch();
+        CHECK(delegate.written == (long) sizeof(data));
+        driver.read_bytes(0, back, sizeof(back));
+        queue.dispatch();
+        CHECK(delegate.read == (long) sizeof(back) && memcmp(back, data, sizeof(data)) == 0);
+
+        const GpoEventStatistics_t statistics = driver.gpo_event_statistics();
+        printf("edges %u, taken by the running event %u\n", (unsigned) statistics.edges, (unsigned) statistics.dropped);
+        CHECK(statistics.edges >= 10 && statistics.dropped == statistics.edges - 2);
+        CHECK(driver.poll_statistics().gpo_fallbacks == 0);
+
+        driver.end_session();
+        queue.dispatch();
+        CHECK(delegate.ended == 1 && queue.next_timed() == -1 && queue.pending() == 0);
+    }
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the CRC engine selected by MBED_CONF_M24SR_CRC_ENGINE against the
+ * bit-serial ISO/IEC 13239 reference, then times both on frame sizes 5 to 246.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "m24sr_crc.h"
+#include "test.h"
+
+using namespace mbed::nfc::vendor::ST;
+
+/* the update_crc of the original driver, one byte at a time */
+static uint16_t reference_crc16_update(uint16_t crc, const uint8_t *data, size_t length) {
+    while (length--) {
+        uint8_t ch = *data++ ^ (uint8_t) (crc & 0x00FF);
+        ch = (ch ^ (ch << 4));
+        crc = (crc >> 8) ^ ((uint16_t) ch << 8) ^ ((uint16_t) ch << 3) ^ ((uint16_t) ch >> 4);
+    }
+
+    return crc;
+}
+
+template<typename F>
+static double ns_per_frame(F crc, const uint8_t *frame, size_t length) {
+    const unsigned iterations = 2000000 / (length + 8);
+    volatile uint16_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < iterations; i++) {
+        sink = sink ^ crc(M24SR_CRC_INIT, frame, length);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+int main() {
+    uint8_t data[512];
+
+    srand(1);
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) rand();
+    }
+
+    /* CRC_A examples of ISO/IEC 14443-3 annex B */
+    const uint8_t zeros[] = {0x00, 0x00};
+    const uint8_t bytes[] = {0x12, 0x34};
+    CHECK(m24sr_crc16(zeros, sizeof(zeros)) == 0x1EA0);
+    CHECK(m24sr_crc16(bytes, sizeof(bytes)) == 0xCF26);
+
+    /* every length, start offset and preset, whole and split in two */
+    for (size_t length = 0; length <= 300; length++) {
+        for (size_t offset = 0; offset < 8; offset++) {
+            const uint8_t *block = data + offset + length % 64;
+            const uint16_t preset = (uint16_t) (M24SR_CRC_INIT ^ (length * 0x1021 + offset));
+            const uint16_t expected = reference_crc16_update(preset, block, length);
+
+            CHECK(m24sr_crc16_update(preset, block, length) == expected);
+            const size_t split = (length * 7 + offset) % (length + 1);
+            CHECK(m24sr_crc16_update(m24sr_crc16_update(preset, block, split), block + split, length - split) == expected);
+        }
+    }
+
+    /* a frame followed by its CRC leaves a zero residue */
+    for (size_t length = 1; length <= 253; length++) {
+        uint8_t frame[256];
+        memcpy(frame, data, length);
+        const uint16_t crc = m24sr_crc16(frame, length);
+        frame[length] = (uint8_t) crc;
+        frame[length + 1] = (uint8_t) (crc >> 8);
+        CHECK(m24sr_crc16(frame, length + 2) == 0);
+    }
+
+    static const size_t sizes[] = {5, 8, 16, 32, 64, 128, 246};
+    printf("crc engine %d, ns per frame (bit-serial reference / engine)\n", MBED_CONF_M24SR_CRC_ENGINE);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        const double reference = ns_per_frame(reference_crc16_update, data, sizes[i]);
+        const double engine = ns_per_frame(m24sr_crc16_update, data, sizes[i]);
+        printf("  %3zu bytes: %8.1f / %8.1f  x%.1f\n", sizes[i], reference, engine, reference / engine);
+    }
+
+    return TEST_EXIT();
+}
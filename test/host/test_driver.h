@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef M24SR_HOST_TEST_DRIVER_H
+#define M24SR_HOST_TEST_DRIVER_H
+
+#include "m24sr_driver.h"
+#include "test.h"
+
+/**
+ * Delegate keeping the last result of each operation, -1 until it is reported.
+ */
+struct RecordingDelegate : mbed::nfc::NFCEEPROMDriver::Delegate {
+    RecordingDelegate()
+        : started(-1), ended(-1), read(-1), written(-1), erased(-1), size_written(-1), size_read(-1), size(0) { }
+
+    virtual void on_session_started(bool success) { started = success; }
+    virtual void on_session_ended(bool success) { ended = success; }
+    virtual void on_bytes_read(size_t count) { read = (long) count; }
+    virtual void on_bytes_written(size_t count) { written = (long) count; }
+    virtual void on_size_written(bool success) { size_written = success; }
+    virtual void on_size_read(bool success, size_t value) { size_read = success; size = value; }
+    virtual void on_bytes_erased(size_t count) { erased = (long) count; }
+
+    int started;
+    int ended;
+    long read;
+    long written;
+    long erased;
+    int size_written;
+    int size_read;
+    size_t size;
+};
+
+#endif // M24SR_HOST_TEST_DRIVER_H
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks that the frame builder specialised on the command mask produces the
+ * same bytes as the runtime mask builder it replaced, for every mask the
+ * driver uses, then times both.
+ */
+
+#include <stdlib.h>
+#include <chrono>
+#include "test.h"
+
+/* the builder is local to the driver translation unit */
+#include "m24sr_driver.cpp"
+
+using namespace mbed::nfc::vendor::ST;
+
+/* build_I_block_command of the original driver, the mask tested at run time */
+static void reference_build_I_block_command(uint16_t command_mask, C_APDU *command, uint8_t did, uint8_t block,
+                                            uint16_t *length, uint8_t *command_buffer) {
+    uint16_t crc16;
+
+    (*length) = 0;
+
+    if ((command_mask & PCB_NEEDED) != 0) {
+        command_buffer[(*length)++] = 0x02 | block;
+    }
+
+    if ((block & DID_NEEDED) != 0) {
+        command_buffer[(*length)++] = did;
+    }
+
+    if ((command_mask & CLA_NEEDED) != 0) {
+        command_buffer[(*length)++] = command->header.CLA;
+    }
+
+    if ((command_mask & INS_NEEDED) != 0) {
+        command_buffer[(*length)++] = command->header.INS;
+    }
+
+    if ((command_mask & P1_NEEDED) != 0) {
+        command_buffer[(*length)++] = command->header.P1;
+    }
+
+    if ((command_mask & P2_NEEDED) != 0) {
+        command_buffer[(*length)++] = command->header.P2;
+    }
+
+    if ((command_mask & LC_NEEDED) != 0) {
+        command_buffer[(*length)++] = command->body.LC;
+    }
+
+    if ((command_mask & DATA_NEEDED) != 0) {
+        if (command->body.data) {
+            memcpy(&(command_buffer[(*length)]), command->body.data, command->body.LC);
+        } else {
+            memset(&(command_buffer[(*length)]), 0, command->body.LC);
+        }
+        (*length) += command->body.LC;
+    }
+
+    if ((command_mask & LE_NEEDED) != 0) {
+        command_buffer[(*length)++] = command->body.LE;
+    }
+
+    if ((command_mask & CRC_NEEDED) != 0) {
+        crc16 = m24sr_crc16(command_buffer, *length);
+        command_buffer[(*length)++] = GETLSB(crc16);
+        command_buffer[(*length)++] = GETMSB(crc16);
+    }
+}
+
+static uint8_t payload[MAX_OPERATION_SIZE];
+
+/* both builders on the same commands: both block numbers, with and without DID, every data length */
+template<uint16_t command_mask>
+static void check_mask(const char *name) {
+    uint8_t expected[MAX_OPERATION_SIZE + 16];
+    uint8_t built[MAX_OPERATION_SIZE + 16];
+    unsigned frames = 0;
+    unsigned mismatches = 0;
+
+    for (unsigned block = 0; block < 4; block++) {
+        const uint8_t pcb_block = (uint8_t) ((block & 1) | ((block & 2) ? DID_NEEDED : 0));
+
+        for (unsigned lc = 0; lc <= MAX_OPERATION_SIZE; lc++) {
+            const uint8_t *data = (lc % 3 == 0) ? NULL : payload + lc % 7;
+            C_APDU command((uint8_t) rand(), (uint8_t) rand(), (uint16_t) rand(), (uint8_t) lc, data, (uint8_t) rand());
+            uint16_t expected_length = 0;
+            uint16_t built_length = 0;
+
+            memset(expected, 0x55, sizeof(expected));
+            memset(built, 0x55, sizeof(built));
+            reference_build_I_block_command(command_mask, &command, 0x5A, pcb_block, &expected_length, expected);
+            build_I_block_command<command_mask>(&command, 0x5A, pcb_block, &built_length, built);
+
+            frames++;
+            if (built_length != expected_length || memcmp(built, expected, sizeof(built)) != 0) {
+                mismatches++;
+            }
+        }
+    }
+
+    printf("  %-40s %u frames, %u mismatches\n", name, frames, mismatches);
+    CHECK(mismatches == 0);
+}
+
+/* the compile time frames against the reference builder */
+template<typename Frame>
+static void check_fixed_frame(const char *name, uint16_t command_mask, C_APDU command) {
+    for (uint8_t block = 0; block < 2; block++) {
+        uint8_t expected[32];
+        uint16_t length = 0;
+
+        reference_build_I_block_command(command_mask, &command, 0, block, &length, expected);
+        CHECK(length == sizeof(Frame::frames[block]));
+        CHECK(memcmp(Frame::frames[block], expected, length) == 0);
+    }
+    printf("  %-40s compile time frames match\n", name);
+}
+
+template<typename F>
+static double ns_per_frame(F build, uint8_t lc) {
+    const unsigned iterations = 200000;
+    uint8_t buffer[MAX_OPERATION_SIZE + 16];
+    volatile uint16_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < iterations; i++) {
+        C_APDU command(C_APDU_CLA_DEFAULT, C_APDU_UPDATE_BINARY, (uint16_t) i, lc, payload, 0);
+        uint16_t length;
+        build(&command, (uint8_t) (i & 1), &length, buffer);
+        sink = sink ^ length ^ buffer[length - 1];
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+#define CHECK_MASK(mask) check_mask<mask>(#mask)
+
+int main() {
+    srand(2);
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t) rand();
+    }
+
+    printf("frame builder, template against runtime mask\n");
+    CHECK_MASK(CMD_MASK_SELECT_APPLICATION);
+    CHECK_MASK(CMD_MASK_SELECT_CC_FILE);
+    CHECK_MASK(CMD_MASK_READ_BINARY);
+    CHECK_MASK(CMD_MASK_UPDATE_BINARY);
+    CHECK_MASK(CMD_MASK_UPDATE_BINARY & ~(DATA_NEEDED | CRC_NEEDED));
+    CHECK_MASK(CMD_MASK_VERIFY_BINARY_WO_PWD);
+    CHECK_MASK(CMD_MASK_VERIFY_BINARY_WITH_PWD);
+    CHECK_MASK(CMD_MASK_CHANGE_REF_DATA);
+    CHECK_MASK(CMD_MASK_ENABLE_VERIFREQ);
+    CHECK_MASK(CMD_MASK_SEND_INTERRUPT);
+    CHECK_MASK(CMD_MASK_GPO_STATE);
+
+    static const uint8_t application_id[] = {NDEF_APPLICATION_ID};
+    static const uint8_t cc_file_id[] = {GETMSB(CC_FILE_ID), GETLSB(CC_FILE_ID)};
+    static const uint8_t system_file_id[] = {GETMSB(SYSTEM_FILE_ID), GETLSB(SYSTEM_FILE_ID)};
+    static const uint8_t ndef_file_id[] = {GETMSB(DEFAULT_NDEF_FILE_ID), GETLSB(DEFAULT_NDEF_FILE_ID)};
+    check_fixed_frame<SelectApplicationFrame>("SelectApplicationFrame", CMD_MASK_SELECT_APPLICATION,
+            C_APDU(C_APDU_CLA_DEFAULT, C_APDU_SELECT_FILE, 0x0400, sizeof(application_id), application_id, 0));
+    check_fixed_frame<SelectCCFileFrame>("SelectCCFileFrame", CMD_MASK_SELECT_CC_FILE,
+            C_APDU(C_APDU_CLA_DEFAULT, C_APDU_SELECT_FILE, 0x000C, sizeof(cc_file_id), cc_file_id, 0));
+    check_fixed_frame<SelectSystemFileFrame>("SelectSystemFileFrame", CMD_MASK_SELECT_CC_FILE,
+            C_APDU(C_APDU_CLA_DEFAULT, C_APDU_SELECT_FILE, 0x000C, sizeof(system_file_id), system_file_id, 0));
+    check_fixed_frame<SelectDefaultNdefFileFrame>("SelectDefaultNdefFileFrame", CMD_MASK_SELECT_NDEF_FILE,
+            C_APDU(C_APDU_CLA_DEFAULT, C_APDU_SELECT_FILE, 0x000C, sizeof(ndef_file_id), ndef_file_id, 0));
+
+    printf("ns per UPDATE BINARY frame (runtime mask / template)\n");
+    static const uint8_t sizes[] = {1, 16, 64, 246};
+    for (size_t i = 0; i < sizeof(sizes); i++) {
+        const double reference = ns_per_frame([](C_APDU *command, uint8_t block, uint16_t *length, uint8_t *buffer) {
+            reference_build_I_block_command(CMD_MASK_UPDATE_BINARY, command, 0, block, length, buffer);
+        }, sizes[i]);
+        const double templated = ns_per_frame([](C_APDU *command, uint8_t block, uint16_t *length, uint8_t *buffer) {
+            build_I_block_command<CMD_MASK_UPDATE_BINARY>(command, 0, block, length, buffer);
+        }, sizes[i]);
+        printf("  %3u bytes: %6.1f / %6.1f\n", sizes[i], reference, templated);
+    }
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Tags behind an emulated multiplexer driven by M24srDriverPool: the writes
+ * to several tags overlap with the EEPROM programming of the others, and the
+ * pool keeps the mode of its drivers across their resets.
+ */
+
+#include <vector>
+#include "m24sr_driver_pool.h"
+#include "m24sr_emulator.h"
+#include "test_driver.h"
+
+using namespace mbed::nfc::vendor::ST;
+
+#define MESSAGE_SIZE 2000
+
+/* @return KB/s written to each of the tags at once */
+static double pool_throughput(int tags) {
+    M24srVirtualClock clock;
+    M24srEmulatedMux mux(clock);
+    M24srDriverPool pool(mux);
+    events::EventQueue queue;
+    std::vector<M24srEmulator *> chips;
+    std::vector<M24srDriver *> drivers;
+    std::vector<RecordingDelegate> delegates(tags);
+    std::vector<uint8_t> message(MESSAGE_SIZE);
+
+    for (size_t i = 0; i < message.size(); i++) {
+        message[i] = (uint8_t) (i * 13);
+    }
+
+    for (int i = 0; i < tags; i++) {
+        chips.push_back(new M24srEmulator(M24srEmulator::M24SR16, &clock));
+        mux.attach(i, chips[i]);
+        drivers.push_back(new M24srDriver(pool.channel(i)));
+        drivers[i]->set_delegate(&delegates[i]);
+        drivers[i]->set_event_queue(&queue);
+        CHECK(pool.add(*drivers[i]));
+        drivers[i]->reset();
+        drivers[i]->start_session(true);
+    }
+    pool.run();
+
+    const uint64_t start = clock.now_us();
+    for (int i = 0; i < tags; i++) {
+        drivers[i]->write_bytes(0, message.data(), message.size());
+    }
+    pool.run();
+    const uint64_t time = clock.now_us() - start;
+
+    for (int i = 0; i < tags; i++) {
+        drivers[i]->end_session();
+    }
+    pool.run();
+
+    for (int i = 0; i < tags; i++) {
+        CHECK(delegates[i].started == 1 && delegates[i].written == MESSAGE_SIZE && delegates[i].ended == 1);
+        CHECK(memcmp(chips[i]->ndef_file() + 2, message.data(), message.size()) == 0);
+        delete drivers[i];
+        delete chips[i];
+    }
+
+    const double throughput = tags * (double) MESSAGE_SIZE / time * 1000;
+    printf("  %d tags: %llu us, %.1f KB/s, %u multiplexer switches\n", tags, (unsigned long long) time,
+           throughput, pool.mux().switches());
+    return throughput;
+}
+
+int main() {
+    printf("pool writing %d bytes to each tag at 400 kHz\n", MESSAGE_SIZE);
+    const double one = pool_throughput(1);
+    const double two = pool_throughput(2);
+    const double four = pool_throughput(4);
+    const double eight = pool_throughput(8);
+
+    /* close to linear until the bus is saturated */
+    CHECK(two > 1.4 * one);
+    CHECK(four > 2.2 * one);
+    CHECK(eight >= four * 0.95);
+
+    /* a driver with a GPO and an event queue, reset after it was added */
+    {
+        M24srVirtualClock clock;
+        M24srEmulatedMux mux(clock);
+        M24srEmulator chip(M24srEmulator::M24SR16, &clock);
+        M24srDriverPool pool(mux);
+        M24srDriver driver(pool.channel(0), 5, NC);
+        RecordingDelegate delegate;
+        events::EventQueue queue;
+        uint8_t data[300];
+
+        mux.attach(0, &chip);
+        driver.set_delegate(&delegate);
+        driver.set_event_queue(&queue);
+        driver.reset();
+        CHECK(pool.add(driver));
+        CHECK(driver.get_communication_mode() == ASYNC);
+
+        driver.reset();
+        CHECK(driver.get_communication_mode() == ASYNC);
+        CHECK(driver.set_communication_mode(SYNC) == M24SR_ERROR);
+
+        memset(data, 0x3C, sizeof(data));
+        driver.start_session(true);
+        pool.run();
+        CHECK(delegate.started == 1);
+        driver.write_bytes(0, data, sizeof(data));
+        /* no answer check is armed, only the pool completes the commands */
+        CHECK(queue.next_timed() == -1);
+        pool.run();
+        CHECK(delegate.written == (long) sizeof(data));
+        CHECK(queue.next_timed() == -1 && queue.pending() == 0);
+        driver.end_session();
+        pool.run();
+        CHECK(delegate.ended == 1 && memcmp(chip.ndef_file() + 2, data, sizeof(data)) == 0);
+    }
+
+    return TEST_EXIT();
+}
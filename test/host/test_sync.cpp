@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2018 ARM Limited
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * SYNC mode: the stack used by each operation must not grow with the number
+ * of commands it chains, and the blocking set up can't run from a callback.
+ */
+
+#include <functional>
+#include "m24sr_emulator.h"
+#include "test_driver.h"
+
+using namespace mbed::nfc::vendor::ST;
+
+/* the deepest stack address seen by the transport */
+static char *stack_low;
+
+class StackProbe : public M24srEmulator {
+public:
+    StackProbe() : M24srEmulator(M24SR64) { }
+
+    virtual int write(uint8_t address, const uint8_t *data, size_t length) {
+        mark();
+        return M24srEmulator::write(address, data, length);
+    }
+
+    virtual int read(uint8_t address, uint8_t *data, size_t length) {
+        mark();
+        return M24srEmulator::read(address, data, length);
+    }
+
+    virtual int read_scatter(uint8_t address, const M24srFragment_t *fragments, size_t count) {
+        mark();
+        return M24srEmulator::read_scatter(address, fragments, count);
+    }
+
+private:
+    void mark() {
+        char here;
+        if (&here < stack_low) {
+            stack_low = &here;
+        }
+    }
+};
+
+/* @return bytes of stack used by the operation below the caller frame */
+__attribute__((noinline)) static long stack_use(const std::function<void()> &operation) {
+    char base;
+    stack_low = &base;
+    operation();
+    return &base - stack_low;
+}
+
+/* resets the driver from the first delegate call it gets */
+struct ResettingDelegate : RecordingDelegate {
+    ResettingDelegate() : driver(NULL), mode_status(M24SR_SUCCESS) { }
+
+    virtual void on_session_started(bool success) {
+        RecordingDelegate::on_session_started(success);
+        mode_status = driver->set_communication_mode(SYNC);
+        driver->reset();
+    }
+
+    M24srDriver *driver;
+    M24srError_t mode_status;
+};
+
+/* a transport which can't see the GPO line, as the mbed I2C one */
+class BlindEmulator : public M24srEmulator {
+public:
+    BlindEmulator() : M24srEmulator(M24SR16) { }
+
+    virtual bool can_wait_gpo_edge() {
+        return false;
+    }
+
+    virtual int wait_gpo_edge(uint32_t timeout_us) {
+        return -1;
+    }
+};
+
+/* a chip which stops answering from a given command frame on */
+class StallingEmulator : public M24srEmulator {
+public:
+    StallingEmulator() : M24srEmulator(M24SR16), stall_at(0), writes(0), stalled_reads(0) { }
+
+    virtual int write(uint8_t address, const uint8_t *data, size_t length) {
+        writes++;
+        return M24srEmulator::write(address, data, length);
+    }
+
+    virtual int read(uint8_t address, uint8_t *data, size_t length) {
+        if (stalled()) {
+            stalled_reads++;
+        }
+        return M24srEmulator::read(address, data, length);
+    }
+
+    virtual int read_scatter(uint8_t address, const M24srFragment_t *fragments, size_t count) {
+        if (stalled()) {
+            stalled_reads++;
+        }
+        return M24srEmulator::read_scatter(address, fragments, count);
+    }
+
+    virtual int poll(uint8_t address) {
+        return stalled() ? -1 : M24srEmulator::poll(address);
+    }
+
+    bool stalled() const {
+        return stall_at != 0 && writes >= stall_at;
+    }
+
+    uint32_t stall_at;
+    uint32_t writes;
+    uint32_t stalled_reads;
+};
+
+/* @return bytes of EEPROM the reset programmed and the I2C GPO function it left */
+static uint32_t reset_with_poll_gpo(M24srEmulator &chip, uint8_t *gpo) {
+    M24srDriver driver(chip);
+    PollConfig_t config = { POLL_GPO, 100000, 100, 2000 };
+    SystemFile_t system_file = SystemFile_t();
+
+    driver.set_poll_config(config);
+    chip.reset_statistics();
+    driver.reset();
+    CHECK(driver.get_system_file(&system_file));
+    *gpo = system_file.gpo & 0x0F;
+    return chip.statistics().programmed_bytes;
+}
+
+int main() {
+    {
+        StackProbe chip;
+        M24srDriver driver(chip);
+        RecordingDelegate delegate;
+        static uint8_t data[4000];
+
+        driver.set_delegate(&delegate);
+        driver.reset();
+        CHECK(driver.get_communication_mode() == SYNC);
+
+        const long session = stack_use([&] { driver.start_session(true); });
+        const long write_two = stack_use([&] { driver.write_bytes(0, data, 300); });
+        const long write_many = stack_use([&] { driver.write_bytes(0, data, sizeof(data)); });
+        const long read_many = stack_use([&] { driver.read_bytes(0, data, sizeof(data)); });
+        const long end = stack_use([&] { driver.end_session(); });
+        CHECK(delegate.started == 1 && delegate.written == (long) sizeof(data) && delegate.read == (long) sizeof(data));
+        CHECK(delegate.ended == 1);
+
+        printf("stack in bytes: start_session %ld, write 2 chunks %ld, write 17 chunks %ld, read 17 chunks %ld, end_session %ld\n",
+               session, write_two, write_many, read_many, end);
+        /* a longer chain of commands doesn't go deeper */
+        CHECK(write_many <= write_two);
+        CHECK(session < 2048 && write_many < 2048 && read_many < 2048 && end < 2048);
+
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+        /* the password changes chain the most commands */
+        M24srError_t status = M24SR_ERROR;
+        static const uint8_t password[16] = { 0 };
+        Request_t request = Request_t();
+        request.password = password;
+        request.new_password = password;
+        RequestCallback_t done = [&](M24srError_t result, size_t) { status = result; };
+
+        stack_use([&] {
+            request.type = REQUEST_START_SESSION;
+            driver.submit(request, done);
+        });
+        request.type = REQUEST_ENABLE_READ_PASSWORD;
+        const long enable = stack_use([&] { driver.submit(request, done); });
+        CHECK(status == M24SR_SUCCESS);
+        request.type = REQUEST_DISABLE_ALL_PASSWORD;
+        const long disable = stack_use([&] { driver.submit(request, done); });
+        CHECK(status == M24SR_SUCCESS);
+
+        request.type = REQUEST_END_SESSION;
+        driver.submit(request, done);
+        printf("stack in bytes: enable read password %ld, disable all passwords %ld\n", enable, disable);
+        CHECK(enable < 2048 && disable < 2048);
+#endif
+    }
+
+#if MBED_CONF_M24SR_REQUEST_QUEUE_SIZE
+    {
+        /* with a GPO pin but no event queue, the answers can't be signalled */
+        M24srEmulator chip(M24srEmulator::M24SR16);
+        M24srDriver driver(chip, (PinName) 5);
+        RecordingDelegate delegate;
+        M24srError_t status = M24SR_SUCCESS;
+        Request_t request = Request_t();
+        RequestCallback_t done = [&](M24srError_t result, size_t) { status = result; };
+
+        driver.set_delegate(&delegate);
+        driver.reset();
+        request.type = REQUEST_I2C_GPO;
+        request.gpo = I2C_ANSWER_READY;
+        driver.submit(request, done);
+        CHECK(status == M24SR_IO_PIN_NOT_CONNECTED);
+        CHECK(driver.get_communication_mode() == SYNC);
+
+        uint8_t data[16] = { 4, 5, 6 };
+        driver.start_session(true);
+        driver.write_bytes(0, data, sizeof(data));
+        CHECK(delegate.written == (long) sizeof(data));
+    }
+#endif
+
+    {
+        /* reset from a delegate runs once the session start is complete */
+        M24srEmulator chip(M24srEmulator::M24SR16);
+        M24srDriver driver(chip);
+        ResettingDelegate delegate;
+        SystemFile_t system_file;
+
+        delegate.driver = &driver;
+        driver.set_delegate(&delegate);
+        driver.reset();
+        chip.reset_statistics();
+
+        driver.start_session(true);
+        CHECK(delegate.started == 1);
+        CHECK(delegate.mode_status == M24SR_ERROR);
+        /* the reset read the system file and closed the session */
+        CHECK(driver.get_system_file(&system_file) && system_file.memory_size == 0x7FF);
+        CHECK(chip.statistics().frames > 3);
+
+        RecordingDelegate plain;
+        uint8_t data[16] = { 1, 2, 3 };
+        driver.set_delegate(&plain);
+        driver.start_session(true);
+        driver.write_bytes(0, data, sizeof(data));
+        driver.end_session();
+        CHECK(plain.started == 1 && plain.written == (long) sizeof(data) && plain.ended == 1);
+        CHECK(memcmp(chip.ndef_file() + 2, data, sizeof(data)) == 0);
+    }
+
+    {
+        /* a command chained by a callback which times out fails without its answer being read */
+        StallingEmulator chip;
+        M24srDriver driver(chip);
+        RecordingDelegate delegate;
+        PollConfig_t config = { POLL_SLEEP, 5000, 100, 2000 };
+
+        driver.set_delegate(&delegate);
+        driver.reset();
+        driver.set_poll_config(config);
+        chip.writes = 0;
+        /* the session, the application, then the CC file which doesn't come back */
+        chip.stall_at = 3;
+
+        driver.start_session(true);
+        CHECK(delegate.started == 0);
+        CHECK(chip.stalled_reads == 0);
+        uint32_t timeouts = 0;
+        for (int command = 0; command < COMMAND_COUNT; command++) {
+            timeouts += driver.poll_statistics().timeouts[command];
+        }
+        CHECK(timeouts == 1);
+    }
+
+    {
+        /* POLL_GPO only sets the GPO up for a transport which sees it */
+        BlindEmulator blind;
+        M24srEmulator chip(M24srEmulator::M24SR16);
+        uint8_t gpo = 0;
+
+        CHECK(reset_with_poll_gpo(blind, &gpo) == 0);
+        CHECK(gpo != I2C_ANSWER_READY);
+        CHECK(reset_with_poll_gpo(chip, &gpo) > 0);
+        CHECK(gpo == I2C_ANSWER_READY);
+    }
+
+    return TEST_EXIT();
+}